@@ -0,0 +1,133 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+static char* block_data(ArenaBlock* block)
+{
+	return (char*)(block + 1);
+}
+
+static ArenaBlock* block_create(size_t size)
+{
+	ArenaBlock* block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + size);
+	if (!block)
+		return nullptr;
+	*block = { .size = size };
+	return block;
+}
+
+//Returns the offset into the block at which an allocation with the given alignment would start
+static size_t block_aligned_offset(ArenaBlock* block, size_t alignment)
+{
+	uintptr_t address = (uintptr_t)(block_data(block) + block->used);
+	uintptr_t aligned = (address + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	return block->used + (aligned - address);
+}
+
+Arena* arena_create(size_t initial_block_size)
+{
+	Arena* arena = new Arena();
+	arena->next_block_size = initial_block_size;
+	arena->head = block_create(initial_block_size);
+	arena->tail = arena->head;
+	return arena;
+}
+
+void* arena_alloc(Arena* arena, size_t size, size_t alignment)
+{
+	ArenaBlock* tail = arena->tail;
+	size_t offset = block_aligned_offset(tail, alignment);
+	if (offset + size <= tail->size)
+	{
+		arena->bytes_used += size;
+		arena->bytes_wasted += offset - tail->used;
+		tail->used = offset + size;
+		return block_data(tail) + offset;
+	}
+
+	//Allocations which would not fit in a regular block get a block of their own. It is linked at the head so
+	//the current tail keeps serving small allocations
+	if (size + alignment > arena->next_block_size)
+	{
+		ArenaBlock* block = block_create(size + alignment);
+		if (!block)
+			return nullptr;
+		block->next = arena->head;
+		arena->head = block;
+		offset = block_aligned_offset(block, alignment);
+		block->used = offset + size;
+		arena->bytes_used += size;
+		arena->bytes_wasted += offset;
+		return block_data(block) + offset;
+	}
+
+	ArenaBlock* block = block_create(arena->next_block_size);
+	if (!block)
+		return nullptr;
+	tail->next = block;
+	if (arena->next_block_size < ARENA_MAX_BLOCK_SIZE)
+		arena->next_block_size *= 2;
+
+	arena->bytes_wasted += tail->size - tail->used;
+	arena->tail = block;
+
+	offset = block_aligned_offset(block, alignment);
+	block->used = offset + size;
+	arena->bytes_used += size;
+	arena->bytes_wasted += offset;
+	return block_data(block) + offset;
+}
+
+char* arena_strdup(Arena* arena, const char* str, size_t length)
+{
+	char* copy = (char*)arena_alloc(arena, length + 1, 1);
+	memcpy(copy, str, length);
+	copy[length] = 0;
+	return copy;
+}
+
+//Releases every allocation but keeps the largest block around so the next file can be parsed without hitting malloc
+void arena_reset(Arena* arena)
+{
+	ArenaBlock* largest = arena->head;
+	for (ArenaBlock* block = arena->head; block; block = block->next)
+		if (block->size > largest->size)
+			largest = block;
+
+	ArenaBlock* block = arena->head;
+	while (block)
+	{
+		ArenaBlock* next = block->next;
+		if (block != largest)
+			free(block);
+		block = next;
+	}
+
+	largest->next = nullptr;
+	largest->used = 0;
+	arena->head = largest;
+	arena->tail = largest;
+	arena->bytes_used = 0;
+	arena->bytes_wasted = 0;
+}
+
+void arena_free(Arena* arena)
+{
+	ArenaBlock* block = arena->head;
+	while (block)
+	{
+		ArenaBlock* next = block->next;
+		free(block);
+		block = next;
+	}
+	delete arena;
+}
+
+size_t arena_bytes_reserved(const Arena* arena)
+{
+	size_t total = 0;
+	for (ArenaBlock* block = arena->head; block; block = block->next)
+		total += block->size;
+	return total;
+}
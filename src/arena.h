@@ -0,0 +1,36 @@
+#pragma once
+#include <stddef.h>
+
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+#define ARENA_MAX_BLOCK_SIZE (16 * 1024 * 1024)
+
+//Header placed in front of every chunk of memory owned by an arena
+struct ArenaBlock
+{
+	ArenaBlock* next = nullptr;
+	size_t size = 0;
+	size_t used = 0;
+};
+
+//Bump pointer allocator. Allocations are only released all at once by arena_reset or arena_free
+struct Arena
+{
+	ArenaBlock* head = nullptr;
+	ArenaBlock* tail = nullptr;
+	size_t next_block_size = ARENA_DEFAULT_BLOCK_SIZE;
+	size_t bytes_used = 0;
+	size_t bytes_wasted = 0;
+};
+
+extern Arena* arena_create(size_t initial_block_size = ARENA_DEFAULT_BLOCK_SIZE);
+extern void* arena_alloc(Arena* arena, size_t size, size_t alignment);
+extern char* arena_strdup(Arena* arena, const char* str, size_t length);
+extern void arena_reset(Arena* arena);
+extern void arena_free(Arena* arena);
+extern size_t arena_bytes_reserved(const Arena* arena);
+
+template<typename T>
+T* arena_alloc_array(Arena* arena, size_t count)
+{
+	return (T*)arena_alloc(arena, sizeof(T) * count, alignof(T));
+}
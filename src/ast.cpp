@@ -1,43 +1,27 @@
 #include "ast.h"
+#include <stdio.h>
 #include <stdlib.h>
 
-bool parse_block(const std::vector<Token*>& tokens, int index, NodeAllocator* node_allocator, Node** block_node, int* next_index);
+bool parse_block(const TokenStream& tokens, int index, NodeAllocator* node_allocator, Node** block_node, int* next_index);
 
 Node* node_alloc(NodeAllocator* allocator)
 {
-	while (allocator->next)
-	{
-		allocator = allocator->next;
-	}
-
-	if (allocator->count == 20)
-	{
-		allocator->next = node_allocator_create();
-		allocator = allocator->next;
-	}
-
-	Node* node = &allocator->data[allocator->count];
-	allocator->count++;
-	return node;
+	return (Node*)arena_alloc(allocator, sizeof(Node), alignof(Node));
 }
 
 NodeAllocator* node_allocator_create()
 {
-	NodeAllocator* allocator = new NodeAllocator();
-	allocator->data = (Node*)malloc(sizeof(Node) * 20);
-	return allocator;
+	return arena_create();
+}
+
+void node_allocator_reset(NodeAllocator* allocator)
+{
+	arena_reset(allocator);
 }
 
 void node_allocator_free(NodeAllocator* allocator)
 {
-	do
-	{
-		if (allocator->data)
-			free(allocator->data);
-		NodeAllocator* a = allocator->next;
-		free(allocator);
-		allocator = a;
-	} while (allocator);
+	arena_free(allocator);
 }
 
 int node_precedence(NodeType type)
@@ -67,28 +51,11 @@ int node_precedence(NodeType type)
 	return 0;
 }
 
-static bool node_is_operator(NodeType type)
-{
-	switch (type)
-	{
-	case NodeType::ADD:
-	case NodeType::SUBTRACT:
-	case NodeType::REFERENCE:
-	case NodeType::DEREFERECE:
-	case NodeType::MULTIPLY:
-	case NodeType::ASSIGN:
-	case NodeType::COMMA:
-		return true;
-	}
-
-	return false;
-}
-
-static int count_stars(const std::vector<Token*>& tokens, int index)
+static int count_stars(const TokenStream& tokens, int index)
 {
 	int count = 0;
 	for (; index < tokens.size(); index++)
-		if (tokens[index]->type == TokenType::STAR)
+		if (tokens.types[index] == TokenType::STAR)
 			count++;
 		else
 			return count;
@@ -96,37 +63,37 @@ static int count_stars(const std::vector<Token*>& tokens, int index)
 }
 
 //Attempts to parse a vardecl node, returs true on sucess and storing result in node
-static bool parse_vardecl_node(const std::vector<Token*>& tokens, int* index, Node* node)
+static bool parse_vardecl_node(const TokenStream& tokens, int* index, Node* node)
 {
 	int i = *index;
 	node->type = NodeType::VARDECL;
 	node->type_descriptor.ptr_count = 0;
-	Token* token = tokens[i];
-	if (token->type != TokenType::IDENTIFIER)
+	TokenType token = tokens.types[i];
+	if (token != TokenType::IDENTIFIER)
 		return false;
-	node->token = token;
+	node->value = tokens.payloads[i];
 
 	i++;
 	if (i >= tokens.size())
 		return false;
-	token = tokens[i];
+	token = tokens.types[i];
 
-	if (token->type != TokenType::COLON)
+	if (token != TokenType::COLON)
 		return false;
 
 	i++;
 	if (i >= tokens.size())
 		return false;
-	token = tokens[i];
+	token = tokens.types[i];
 
-	if (token->type == TokenType::IDENTIFIER)
+	if (token == TokenType::IDENTIFIER)
 	{
 		node->type_descriptor.base_type = BaseType::NOT_EVALUATED;
-		node->type_descriptor.type_name = token->name;
+		node->type_descriptor.type_name = tokens.payloads[i].name;
 	}
-	else if (token->type == TokenType::S16)
+	else if (token == TokenType::S16)
 	{
-		node->type_descriptor.type_name = token->name;
+		node->type_descriptor.type_name = tokens.payloads[i].name;
 		node->type_descriptor.base_type = BaseType::S16;
 	}
 	else
@@ -137,18 +104,18 @@ static bool parse_vardecl_node(const std::vector<Token*>& tokens, int* index, No
 	i++;
 	if (i >= tokens.size())
 		return false;
-	token = tokens[i];
+	token = tokens.types[i];
 
-	while (token->type == TokenType::STAR)
+	while (token == TokenType::STAR)
 	{
 		node->type_descriptor.ptr_count++;
 		i++;
 		if (i >= tokens.size())
 			return false;
-		token = tokens[i];
+		token = tokens.types[i];
 	}
 
-	if (token->type == TokenType::SEMICOLON || (token->flags & TOKEN_FLAG_OPERATOR))
+	if (token == TokenType::SEMICOLON || (token_flags(token) & TOKEN_FLAG_OPERATOR))
 	{
 		*index = i - 1;
 		return true;
@@ -157,327 +124,256 @@ static bool parse_vardecl_node(const std::vector<Token*>& tokens, int* index, No
 	return false;
 }
 
-static Node* token_to_node(const std::vector<Token*>& tokens, NodeAllocator* node_allocator, int* index)
+static Node* new_node(NodeAllocator* node_allocator, NodeType type, TokenPayload value)
 {
-	Token* token = tokens[*index];
-	Node* node = nullptr;
-	switch (token->type)
+	Node* node = node_alloc(node_allocator);
+	*node = {
+		.type = type,
+		.precedence = node_precedence(type),
+		.value = value
+	};
+	return node;
+}
+
+static void set_children(Node* node, Node* left, Node* right)
+{
+	node->left = left;
+	node->right = right;
+	if (left)
+		left->parent = node;
+	if (right)
+		right->parent = node;
+}
+
+//Returns the node type of a binary operator token, or INVALID if the token is not one
+static NodeType binary_operator(TokenType token)
+{
+	switch (token)
 	{
 	case TokenType::PLUS:
-		node = node_alloc(node_allocator);
-		*node = {
-			.type = NodeType::ADD,
-			.token = token
-		};
-		return node;
-	case TokenType::EQUALS:
-		node = node_alloc(node_allocator);
-		*node = {
-			.type = NodeType::ASSIGN,
-			.token = token
-		};
-		return node;
-	case TokenType::COMMA:
-		node = node_alloc(node_allocator);
-		*node = {
-			.type = NodeType::COMMA,
-			.token = token
-		};
-		return node;
-	case TokenType::AMP:
-		node = node_alloc(node_allocator);
-		*node = {
-			.type = NodeType::REFERENCE,
-			.token = token
-		};
-		return node;
+		return NodeType::ADD;
 	case TokenType::MINUS:
-		node = node_alloc(node_allocator);
-		*node = {
-			.type = NodeType::SUBTRACT,
-			.token = token
-		};
-		return node;
+		return NodeType::SUBTRACT;
 	case TokenType::STAR:
-		node = node_alloc(node_allocator);
-		if (*index == 0 || tokens[*index - 1]->flags & TOKEN_FLAG_OPERATOR)
-		{
-			*node = {
-				.type = NodeType::DEREFERECE,
-				.token = token
-			};
-			return node;
-		}
-		*node = {
-			.type = NodeType::MULTIPLY,
-			.token = token
-		};
-		return node;
+		return NodeType::MULTIPLY;
+	case TokenType::EQUALS:
+		return NodeType::ASSIGN;
+	case TokenType::COMMA:
+		return NodeType::COMMA;
+	}
+	return NodeType::INVALID;
+}
+
+static Node* parse_binary(const TokenStream& tokens, NodeAllocator* node_allocator, int* index, int min_precedence, bool* failed);
+
+//Parses a parenthesised expression starting at the open paren. Empty parens leave node null
+static void parse_group(const TokenStream& tokens, NodeAllocator* node_allocator, int* index, Node** node, bool* failed)
+{
+	*node = nullptr;
+	(*index)++;
+	if (*index < tokens.size() && tokens.types[*index] == TokenType::CLOSE_PAREN)
+	{
+		(*index)++;
+		return;
+	}
+
+	Node* expression = parse_binary(tokens, node_allocator, index, 0, failed);
+	if (*failed)
+		return;
+	if (!expression || *index >= tokens.size() || tokens.types[*index] != TokenType::CLOSE_PAREN)
+	{
+		token_error(tokens, *index, "Expected ')'");
+		*failed = true;
+		return;
+	}
+
+	(*index)++;
+	expression->paren = true;
+	*node = expression;
+}
+
+//Parses a literal, identifier, declaration, call or parenthesised expression. Returns null without consuming
+//anything if the current token cannot start one
+static Node* parse_primary(const TokenStream& tokens, NodeAllocator* node_allocator, int* index, bool* failed)
+{
+	if (*index >= tokens.size())
+		return nullptr;
+
+	Node* node = nullptr;
+	switch (tokens.types[*index])
+	{
 	case TokenType::INT_LITERAL:
-		node = node_alloc(node_allocator);
-		*node = {
-			.type = NodeType::INT_LITERAL,
-			.token = token
-		};
+		node = new_node(node_allocator, NodeType::INT_LITERAL, tokens.payloads[*index]);
+		(*index)++;
 		return node;
-	case TokenType::S16:
-	{
-		Node n = {};
-		if (parse_vardecl_node(tokens, index, &n))
+	case TokenType::OPEN_PAREN:
+		parse_group(tokens, node_allocator, index, &node, failed);
+		if (!node && !*failed)
 		{
-			node = node_alloc(node_allocator);
-			*node = n;
-			return node;
+			token_error(tokens, *index - 1, "Expected an expression inside parentheses");
+			*failed = true;
 		}
-		return nullptr;
-	}
+		return node;
 	case TokenType::IDENTIFIER:
-		node = node_alloc(node_allocator);
-		if (*index + 1 < tokens.size() && tokens[*index + 1]->type == TokenType::OPEN_PAREN)
+	{
+		if (*index + 1 < tokens.size() && tokens.types[*index + 1] == TokenType::OPEN_PAREN)
 		{
-			*node = {
-				.type = NodeType::CALL,
-				.token = token,
-				.paren = true
-			};
+			node = new_node(node_allocator, NodeType::CALL, tokens.payloads[*index]);
+			node->paren = true;
+			(*index)++;
+
+			Node* arguments;
+			parse_group(tokens, node_allocator, index, &arguments, failed);
+			if (*failed)
+				return nullptr;
+			set_children(node, nullptr, arguments);
 			return node;
 		}
+
 		Node n = {};
-		if (parse_vardecl_node(tokens, index, &n))
+		int i = *index;
+		if (parse_vardecl_node(tokens, &i, &n))
 		{
+			node = node_alloc(node_allocator);
 			*node = n;
+			node->precedence = node_precedence(NodeType::VARDECL);
+			*index = i + 1;
 			return node;
 		}
-		*node = {
-			.type = NodeType::IDENTIFIER,
-			.token = token
-		};
+
+		node = new_node(node_allocator, NodeType::IDENTIFIER, tokens.payloads[*index]);
+		(*index)++;
 		return node;
 	}
+	}
 
 	return nullptr;
 }
 
-//True if the node type can only have a right child
-static bool node_is_right_only(NodeType type)
+//Parses a primary along with any prefix operators in front of it
+static Node* parse_unary(const TokenStream& tokens, NodeAllocator* node_allocator, int* index, bool* failed)
 {
-	switch (type)
+	//Each prefix operator takes the ones before it as its operand, so the last one written ends up outermost
+	//and the primary hangs off the first. This matches the shape the tree builder has always produced
+	Node* outer = nullptr;
+	Node* inner = nullptr;
+	while (*index < tokens.size() && (tokens.types[*index] == TokenType::AMP || tokens.types[*index] == TokenType::STAR))
 	{
-	case NodeType::REFERENCE:
-	case NodeType::DEREFERECE:
-	case NodeType::CALL:
-		return true;
+		NodeType type = tokens.types[*index] == TokenType::AMP ? NodeType::REFERENCE : NodeType::DEREFERECE;
+		Node* node = new_node(node_allocator, type, tokens.payloads[*index]);
+		if (outer)
+			set_children(node, nullptr, outer);
+		else
+			inner = node;
+		outer = node;
+		(*index)++;
 	}
 
-	return false;
-}
-
-static Node* parse_tree(const std::vector<Token*>& tokens, NodeAllocator* node_allocator, int* index)
-{
-	Node* tree_head = nullptr;
-	Node* previous_node = nullptr;
-	for (; *index < tokens.size(); (*index)++)
+	Node* primary = parse_primary(tokens, node_allocator, index, failed);
+	if (!primary)
 	{
-		Token* token = tokens[*index];
-		if (token->type == TokenType::CLOSE_PAREN || token->type == TokenType::SEMICOLON)
+		if (outer && !*failed)
 		{
-			(*index)++;
-			return tree_head;
+			token_error(tokens, *index, "Expected an operand");
+			*failed = true;
 		}
-		Node* node = nullptr;
-
-		if (token->type == TokenType::OPEN_PAREN)
-		{
-			(*index)++;
-			node = parse_tree(tokens, node_allocator, index);
-
-			//We should now be on the next token. We don't want to increment on the next continue
-			(*index)--;
-
-			if (!node)
-				continue;
-
-			node->paren = true;
-
-			if (previous_node && (node_is_operator(previous_node->type) || previous_node->type == NodeType::CALL))
-			{
-				previous_node->left = previous_node->right;
-				previous_node->right = node;
-				node->parent = previous_node;
-				previous_node = node;
-				
-				continue;
-			}
-
-			previous_node = node;
-
-			if (!tree_head)
-			{
-				tree_head = node;
-				continue;
-			}
-
-			tree_head->parent = node;
-			node->left = tree_head;
-			tree_head = node;
-			continue;
-		}
-
-		node = token_to_node(tokens, node_allocator, index);
-
-		//Return early if the token could not converted to a node which can be appended to the tree
-		if (node == nullptr)
-			return tree_head;
+		return nullptr;
+	}
 
-		node->precedence = node_precedence(node->type);
+	if (!outer)
+		return primary;
+	set_children(inner, nullptr, primary);
+	return outer;
+}
 
-		if (tree_head == nullptr)
-		{
-			tree_head = node;
-			previous_node = node;
-			continue;
-		}
+//Returns the precedence of the binary operator at index, or -1 if there is none
+static int binary_precedence(const TokenStream& tokens, int index)
+{
+	if (index >= tokens.size())
+		return -1;
+	NodeType type = binary_operator(tokens.types[index]);
+	return type == NodeType::INVALID ? -1 : node_precedence(type);
+}
 
+//Precedence climbing over the binary operators following left. Operators of equal precedence associate to the
+//left, and the parser only recurses when the precedence goes up so flat chains are handled in a single loop
+static Node* parse_binary_rest(const TokenStream& tokens, NodeAllocator* node_allocator, int* index, Node* left, int min_precedence, bool* failed)
+{
+	int precedence = binary_precedence(tokens, *index);
+	while (precedence >= min_precedence)
+	{
+		Node* node = new_node(node_allocator, binary_operator(tokens.types[*index]), tokens.payloads[*index]);
+		(*index)++;
 
-		//Locate the node we will be appending to or replacing based on the operator precedence
-		Node* active_node = tree_head;
-		while (active_node)
+		Node* right = parse_unary(tokens, node_allocator, index, failed);
+		if (!right)
 		{
-			if (active_node->type != NodeType::INT_LITERAL &&
-				active_node->type != NodeType::IDENTIFIER &&
-				active_node->type != NodeType::REFERENCE &&
-				active_node->type != NodeType::DEREFERECE &&
-				active_node->type != NodeType::VARDECL &&
-				!active_node->paren &&
-				active_node->left == nullptr)
-			{
-				active_node->left = active_node->right;
-				active_node->right = node;
-				node->parent = active_node;
-				break;
-			}
-
-			if (active_node->precedence >= node->precedence || active_node->paren)
-			{
-				//The active node is the head
-				if (!active_node->parent)
-				{
-					tree_head = node;
-					node->right = active_node;
-					active_node->parent = node;
-					break;
-				}
-
-				//The node will be appended to the active node's parent
-				if (!active_node->parent->left)
-				{
-					active_node->parent->left = active_node;
-					active_node->parent->right = node;
-					node->parent = active_node->parent;
-					break;
-				}
-
-				//The active node will be replaced in the tree
-				active_node->parent->right = node;
-				node->parent = active_node->parent;
-				node->right = active_node;
-				active_node->parent = node;
-				break;
-			}
-			if (!active_node->right)
+			if (!*failed)
 			{
-				active_node->right = node;
-				node->parent = active_node;
-				break;
+				token_error(tokens, *index, "Expected an operand");
+				*failed = true;
 			}
-
-			active_node = active_node->right;
+			return nullptr;
 		}
 
-		previous_node = node;
-
-		if (!active_node)
+		int next_precedence = binary_precedence(tokens, *index);
+		while (next_precedence > precedence)
 		{
-			puts("Failed to append token node to tree");
-			return tree_head;
+			right = parse_binary_rest(tokens, node_allocator, index, right, precedence + 1, failed);
+			if (!right)
+				return nullptr;
+			next_precedence = binary_precedence(tokens, *index);
 		}
+
+		set_children(node, left, right);
+		left = node;
+		precedence = next_precedence;
 	}
 
-	return tree_head;
+	return left;
 }
 
-static void print_tree_recurse(FILE* file, Node* tree, int tabs)
+static Node* parse_binary(const TokenStream& tokens, NodeAllocator* node_allocator, int* index, int min_precedence, bool* failed)
 {
-	if(tree->right)
-		print_tree_recurse(file, tree->right, tabs + 1);
-	for (int i = 0; i < tabs; i++)
-		fwrite("\t", 1, 1, file);
-	switch (tree->type)
-	{
-	case NodeType::INT_LITERAL:
-		fprintf(file, "%i", tree->token->parsed_int);
-		break;
-	case NodeType::IDENTIFIER:
-		fprintf(file, "%s", tree->token->name);
-		break;
-	case NodeType::ASSIGN:
-		fprintf(file, "%s", "=");
-		break;
-	case NodeType::VARDECL:
-		fprintf(file, "%s", "decl");
-		break;
-	case NodeType::REFERENCE:
-		fprintf(file, "%s", "ref");
-		break;
-	case NodeType::DEREFERECE:
-		fprintf(file, "%s", "deref");
-		break;
-	case NodeType::MULTIPLY:
-		fprintf(file, "%s", "*");
-		break;
-	case NodeType::ADD:
-		fprintf(file, "%s", "+");
-		break;
-	case NodeType::SUBTRACT:
-		fprintf(file, "%s", "-");
-		break;
-	case NodeType::COMMA:
-		fprintf(file, "%s", ",");
-		break;
-	case NodeType::CALL:
-		fprintf(file, "%s()", tree->token->name);
-		break;
-	case NodeType::EXP_SEQUENCE:
-		fprintf(file, "%s", "seq");
-		break;
-	case NodeType::IF:
-		fprintf(file, "%s", "IF");
-		break;
-	case NodeType::IF_BRANCH:
-		fprintf(file, "%s", "IF_BRANCH");
-		break;
-	}
-	fwrite("\n", 1, 1, file);
-	if(tree->left)
-		print_tree_recurse(file, tree->left, tabs + 1);
+	Node* left = parse_unary(tokens, node_allocator, index, failed);
+	if (!left)
+		return nullptr;
+	return parse_binary_rest(tokens, node_allocator, index, left, min_precedence, failed);
 }
 
-void print_tree(const char* filepath, Node* tree)
+//Parses an expression ending in a semicolon or close paren, which are consumed. Any other token which cannot
+//continue the expression ends it without being consumed
+static Node* parse_tree(const TokenStream& tokens, NodeAllocator* node_allocator, int* index)
 {
-	if (filepath == nullptr)
-		filepath = "/code/ast.txt";
-	FILE* file = nullptr;
-	file = fopen(filepath, "w");
-	if (!file)
+	bool failed = false;
+	Node* tree = parse_binary(tokens, node_allocator, index, 0, &failed);
+	if (failed)
+		return nullptr;
+	if (*index >= tokens.size())
+		return tree;
+
+	switch (tokens.types[*index])
 	{
-		printf("Failed to open file for tree printing %s", filepath);
-		return;
+	case TokenType::SEMICOLON:
+	case TokenType::CLOSE_PAREN:
+		(*index)++;
+		break;
+	case TokenType::IDENTIFIER:
+	case TokenType::INT_LITERAL:
+	case TokenType::AMP:
+	case TokenType::OPEN_PAREN:
+		if (tree)
+		{
+			token_error(tokens, *index, "Expected an operator");
+			return nullptr;
+		}
+		break;
 	}
-	print_tree_recurse(file, tree, 0);
-	fclose(file);
+
+	return tree;
 }
 
-bool parse_expression(const std::vector<Token*>& tokens, int index, NodeAllocator* node_allocator, Node** node, int* next_index)
+bool parse_expression(const TokenStream& tokens, int index, NodeAllocator* node_allocator, Node** node, int* next_index)
 {
 	Node* tree_head = nullptr;
 
@@ -490,19 +386,19 @@ bool parse_expression(const std::vector<Token*>& tokens, int index, NodeAllocato
 	return true;
 }
 
-bool parse_type(const std::vector<Token*>& tokens, int index, TypeDescriptor* descriptor, int* next_index)
+bool parse_type(const TokenStream& tokens, int index, TypeDescriptor* descriptor, int* next_index)
 {
-	Token* token = tokens[index];
-	if (token->type == TokenType::IDENTIFIER)
+	TokenType token = tokens.types[index];
+	if (token == TokenType::IDENTIFIER)
 	{
 		descriptor->base_type = BaseType::NOT_EVALUATED;
-		descriptor->type_name = token->name;
+		descriptor->type_name = tokens.payloads[index].name;
 	}
-	else if (token->type == TokenType::S16)
+	else if (token == TokenType::S16)
 	{
 		descriptor->base_type = BaseType::S16;
 	}
-	else if (token->type == TokenType::VOID)
+	else if (token == TokenType::VOID)
 	{
 		descriptor->base_type = BaseType::VOID;
 	}
@@ -514,31 +410,31 @@ bool parse_type(const std::vector<Token*>& tokens, int index, TypeDescriptor* de
 	index++;
 	if (index >= tokens.size())
 		return false;
-	token = tokens[index];
+	token = tokens.types[index];
 
-	while (token->type == TokenType::STAR)
+	while (token == TokenType::STAR)
 	{
 		descriptor->ptr_count++;
 		index++;
 		if (index >= tokens.size())
 			return false;
-		token = tokens[index];
+		token = tokens.types[index];
 	}
 
 	*next_index = index;
 	return true;
 }
 
-static bool parse_func_return(const std::vector<Token*>& tokens, int index, int* next_index, FunctionDescriptor* func)
+static bool parse_func_return(const TokenStream& tokens, int index, int* next_index, FunctionDescriptor* func)
 {
-	Token* token = tokens[index];
-	if (token->type != TokenType::ARROW)
+	TokenType token = tokens.types[index];
+	if (token != TokenType::ARROW)
 		return false;
 
 	index++;
 	if (index >= tokens.size())
 		return false;
-	token = tokens[index];
+	token = tokens.types[index];
 
 	int n = index;
 	if (!parse_type(tokens, index, &func->return_type, &n))
@@ -550,55 +446,55 @@ static bool parse_func_return(const std::vector<Token*>& tokens, int index, int*
 	return true;
 }
 
-bool parse_func_declaration(const std::vector<Token*>& tokens, int index, FunctionDescriptor* descriptor, int* next_index)
+bool parse_func_declaration(const TokenStream& tokens, int index, FunctionDescriptor* descriptor, int* next_index)
 {
-	Token* token = tokens[index];
+	TokenType token = tokens.types[index];
 	int n = 0;
 
-	if (token->type != TokenType::IDENTIFIER)
+	if (token != TokenType::IDENTIFIER)
 		return false;
-	descriptor->name = token->name;
+	descriptor->name = tokens.payloads[index].name;
 
 	index++;
 	if (index >= tokens.size())
 		return false;
-	token = tokens[index];
+	token = tokens.types[index];
 
-	if (token->type != TokenType::COLON)
+	if (token != TokenType::COLON)
 		return false;
 
 	index++;
 	if (index >= tokens.size())
 		return false;
-	token = tokens[index];
+	token = tokens.types[index];
 
-	if (token->type != TokenType::OPEN_PAREN)
+	if (token != TokenType::OPEN_PAREN)
 		return false;
 
 	index++;
 	if (index >= tokens.size())
 		return false;
-	token = tokens[index];
+	token = tokens.types[index];
 
 	if (parse_type(tokens, index, &descriptor->this_type_descriptor, &n) &&
 		n < tokens.size() &&
-		(tokens[n]->type == TokenType::COMMA || tokens[n]->type == TokenType::CLOSE_PAREN))
+		(tokens.types[n] == TokenType::COMMA || tokens.types[n] == TokenType::CLOSE_PAREN))
 	{
 		descriptor->has_this = true;
 		index = n;
 		if (index >= tokens.size())
 			return false;
-		token = tokens[index];
+		token = tokens.types[index];
 	}
 
-	if (token->type == TokenType::CLOSE_PAREN)
+	if (token == TokenType::CLOSE_PAREN)
 	{
 		index++;
 		if (index >= tokens.size())
 			return false;
-		token = tokens[index];
+		token = tokens.types[index];
 
-		if (token->type != TokenType::ARROW)
+		if (token != TokenType::ARROW)
 		{
 			descriptor->return_type.base_type = BaseType::VOID;
 			descriptor->return_type.ptr_count = 0;
@@ -613,35 +509,35 @@ bool parse_func_declaration(const std::vector<Token*>& tokens, int index, Functi
 		return true;
 	}
 
-	if (token->type == TokenType::COMMA)
+	if (token == TokenType::COMMA)
 	{
 		index++;
 		if (index >= tokens.size())
 			return false;
-		token = tokens[index];
+		token = tokens.types[index];
 	}
 
 	while (true)
 	{
 		FunctionParameter param = {};
 
-		if (token->type != TokenType::IDENTIFIER)
+		if (token != TokenType::IDENTIFIER)
 			return false;
 
-		param.name = token->name;
+		param.name = tokens.payloads[index].name;
 
 		index++;
 		if (index >= tokens.size())
 			return false;
-		token = tokens[index];
+		token = tokens.types[index];
 
-		if (token->type != TokenType::COLON)
+		if (token != TokenType::COLON)
 			return false;
 
 		index++;
 		if (index >= tokens.size())
 			return false;
-		token = tokens[index];
+		token = tokens.types[index];
 
 		if (!parse_type(tokens, index, &param.type_descriptor, &n))
 			return false;
@@ -651,30 +547,30 @@ bool parse_func_declaration(const std::vector<Token*>& tokens, int index, Functi
 		index = n;
 		if (index >= tokens.size())
 			return false;
-		token = tokens[index];
+		token = tokens.types[index];
 
-		if (token->type == TokenType::COMMA)
+		if (token == TokenType::COMMA)
 		{
 			index++;
 			if (index >= tokens.size())
 				return false;
-			token = tokens[index];
+			token = tokens.types[index];
 			continue;
 		}
 
-		if (token->type == TokenType::CLOSE_PAREN)
+		if (token == TokenType::CLOSE_PAREN)
 		{
 			index++;
 			if (index >= tokens.size())
 				return false;
-			token = tokens[index];
+			token = tokens.types[index];
 			break;
 		}
 
 		return false;
 	}
 
-	if (token->type != TokenType::ARROW)
+	if (token != TokenType::ARROW)
 	{
 		descriptor->return_type.base_type = BaseType::VOID;
 		descriptor->return_type.ptr_count = 0;
@@ -712,16 +608,16 @@ static void prepend_expression(Node** head, Node* expression, NodeAllocator* nod
 	(*head)->right = expression;
 }
 
-bool parse_if(const std::vector<Token*>& tokens, int index, NodeAllocator* node_allocator, Node** head, int* next_index)
+bool parse_if(const TokenStream& tokens, int index, NodeAllocator* node_allocator, Node** head, int* next_index)
 {
-	Token* token = tokens[index];
-	if (token->type != TokenType::IF)
+	TokenType token = tokens.types[index];
+	if (token != TokenType::IF)
 		return false;
 
 	index++;
 	if (index >= tokens.size())
 		return false;;
-	token = tokens[index];
+	token = tokens.types[index];
 
 	Node* node;
 	int next;
@@ -736,7 +632,7 @@ bool parse_if(const std::vector<Token*>& tokens, int index, NodeAllocator* node_
 	index = next;
 	if (index >= tokens.size())
 		return false;
-	token = tokens[index];
+	token = tokens.types[index];
 
 	if (!parse_block(tokens, index, node_allocator, &node, &next))
 		return false;
@@ -746,24 +642,27 @@ bool parse_if(const std::vector<Token*>& tokens, int index, NodeAllocator* node_
 	branch_node->parent = if_node;
 	if_node->right = branch_node;
 	branch_node->left = node;
+	if (node)
+		node->parent = branch_node;
 
 	index = next;
 	if (index >= tokens.size())
 		return false;
-	token = tokens[index];
+	token = tokens.types[index];
 
-	if (token->type == TokenType::ELSE)
+	if (token == TokenType::ELSE)
 	{
 		index++;
 		if (index >= tokens.size())
 			return false;
-		token = tokens[index];
+		token = tokens.types[index];
 
 		if (!parse_block(tokens, index, node_allocator, &node, &next))
 			return false;
 
 		branch_node->right = node;
-		node->parent = branch_node;
+		if (node)
+			node->parent = branch_node;
 	}
 
 	*head = if_node;
@@ -771,16 +670,16 @@ bool parse_if(const std::vector<Token*>& tokens, int index, NodeAllocator* node_
 	return true;
 }
 
-bool parse_block(const std::vector<Token*>& tokens, int index, NodeAllocator* node_allocator, Node** block_node, int* next_index)
+bool parse_block(const TokenStream& tokens, int index, NodeAllocator* node_allocator, Node** block_node, int* next_index)
 {
-	Token* token = tokens[index];
-	if(token->type != TokenType::OPEN_BRACE)
+	TokenType token = tokens.types[index];
+	if(token != TokenType::OPEN_BRACE)
 		return false;
 
 	index++;
 	if(index >= tokens.size())
 		return false;
-	token = tokens[index];
+	token = tokens.types[index];
 
 	Node* head = nullptr;
 	int next = index;
@@ -788,11 +687,11 @@ bool parse_block(const std::vector<Token*>& tokens, int index, NodeAllocator* no
 	while (true)
 	{
 		Node* node;
-		if (token->type == TokenType::IF)
+		if (token == TokenType::IF)
 		{
 			if (!parse_if(tokens, index, node_allocator, &node, &next))
 			{
-				puts("Failed to parse if statement");
+				token_error(tokens, index, "Failed to parse if statement");
 				return false;
 			}
 
@@ -814,13 +713,18 @@ bool parse_block(const std::vector<Token*>& tokens, int index, NodeAllocator* no
 		{
 			prepend_expression(&head, node, node_allocator);
 		}
+		else if (token != TokenType::CLOSE_BRACE)
+		{
+			token_error(tokens, index, "Expected an expression");
+			return false;
+		}
 
 		index = next;
 		if (index >= tokens.size())
 			return false;
-		token = tokens[index];
+		token = tokens.types[index];
 
-		if (token->type == TokenType::CLOSE_BRACE)
+		if (token == TokenType::CLOSE_BRACE)
 			break;
 	}
 
@@ -830,19 +734,25 @@ bool parse_block(const std::vector<Token*>& tokens, int index, NodeAllocator* no
 	return true;
 }
 
-bool parse_function(std::vector<Token*>& tokens, int index, NodeAllocator* node_allocator, FunctionDescriptor* function, int* next_index)
+bool parse_function(const TokenStream& tokens, int index, NodeAllocator* node_allocator, FunctionDescriptor* function, int* next_index)
 {
 	int next = index;
 	if (!parse_func_declaration(tokens, index, function, &next))
+	{
+		token_error(tokens, index, "Invalid function declaration");
 		return false;
+	}
 
 	index = next;
 	if (index >= tokens.size())
 		return false;
-	Token* token = tokens[index];
+	TokenType token = tokens.types[index];
 
-	if (token->type != TokenType::OPEN_BRACE)
+	if (token != TokenType::OPEN_BRACE)
+	{
+		token_error(tokens, index, "Expected '{' after function declaration");
 		return false;
+	}
 
 	if (!parse_block(tokens, index, node_allocator, &function->node, &next))
 		return false;
@@ -851,3 +761,24 @@ bool parse_function(std::vector<Token*>& tokens, int index, NodeAllocator* node_
 	*next_index = index;
 	return true;
 }
+
+//Parses a body whose token range was recorded when the declaration was parsed on its own
+bool parse_function_body(const TokenStream& tokens, NodeAllocator* node_allocator, FunctionDescriptor* function)
+{
+	int next = function->body_begin;
+	if (!parse_block(tokens, function->body_begin, node_allocator, &function->node, &next))
+	{
+		function->body_state = BodyState::FAILED;
+		return false;
+	}
+
+	if (next != function->body_end)
+	{
+		token_error(tokens, next, "Unexpected token after function body");
+		function->body_state = BodyState::FAILED;
+		return false;
+	}
+
+	function->body_state = BodyState::PARSED;
+	return true;
+}
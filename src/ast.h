@@ -1,7 +1,8 @@
 #pragma once
 #include "tokenize.h"
+#include "arena.h"
 
-enum class NodeType
+enum class NodeType : uint8_t
 {
 	INVALID,
 	INT_LITERAL,
@@ -34,7 +35,7 @@ enum class BaseType
 struct TypeDescriptor
 {
 	BaseType base_type = BaseType::INVALID;
-	const char* type_name = nullptr;
+	Symbol type_name = SYMBOL_NONE;
 	int ptr_count = 0;
 };
 
@@ -45,40 +46,51 @@ struct Node
 	Node* parent = nullptr;
 	Node* left = nullptr;
 	Node* right = nullptr;
-	Token* token = nullptr;
+	//Copy of the token payload, so trees stay valid after the tokens they came from are gone
+	TokenPayload value = {};
 	bool paren = false;
 	TypeDescriptor type_descriptor;
 };
 
-struct NodeAllocator
-{
-	Node* data = nullptr;
-	int count = 0;
-	NodeAllocator* next = nullptr;
-};
+typedef Arena NodeAllocator;
 
 struct FunctionParameter
 {
-	const char* name;
+	Symbol name;
 	TypeDescriptor type_descriptor;
 };
 
+enum class BodyState
+{
+	PARSED,
+	//Only the token range of the body is known, it is parsed on first use
+	PENDING,
+	//The body is still in the file's parse cache entry, body_begin is the index of the function in it
+	CACHED,
+	FAILED,
+};
+
 struct FunctionDescriptor
 {
-	const char* name;
+	Symbol name;
 	std::vector<FunctionParameter> parameters;
 	TypeDescriptor return_type;
 	TypeDescriptor this_type_descriptor;
 	Node* node;
 	bool has_this;
+	BodyState body_state = BodyState::PARSED;
+	//Index of the body's open brace and one past its close brace
+	int body_begin = 0;
+	int body_end = 0;
 };
 
 extern Node* node_alloc(NodeAllocator* allocator);
 extern NodeAllocator* node_allocator_create();
+extern void node_allocator_reset(NodeAllocator* allocator);
 extern void node_allocator_free(NodeAllocator* allocator);
 extern int node_precedence(NodeType type);
-extern bool parse_expression(const std::vector<Token*>& tokens, int index, NodeAllocator* node_allocator, Node** node, int* next_index);
-extern bool parse_type(const std::vector<Token*>& tokens, int index, TypeDescriptor* descriptor, int* next_index);
-extern bool parse_func_declaration(const std::vector<Token*>& tokens, int index, FunctionDescriptor* descriptor, int* next_index);
-extern bool parse_function(std::vector<Token*>& tokens, int index, NodeAllocator* node_allocator, FunctionDescriptor* function, int* next_index);
-extern void print_tree(const char* filepath, Node* tree);
+extern bool parse_expression(const TokenStream& tokens, int index, NodeAllocator* node_allocator, Node** node, int* next_index);
+extern bool parse_type(const TokenStream& tokens, int index, TypeDescriptor* descriptor, int* next_index);
+extern bool parse_func_declaration(const TokenStream& tokens, int index, FunctionDescriptor* descriptor, int* next_index);
+extern bool parse_function(const TokenStream& tokens, int index, NodeAllocator* node_allocator, FunctionDescriptor* function, int* next_index);
+extern bool parse_function_body(const TokenStream& tokens, NodeAllocator* node_allocator, FunctionDescriptor* function);
@@ -0,0 +1,411 @@
+#include "ast_file.h"
+#include "parser.h"
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <unordered_map>
+#include <vector>
+
+struct AstFileWriter
+{
+	std::vector<char> data;
+	//Strings go at the end of the file, so fields referring to them are patched once they are written
+	std::vector<std::pair<uint32_t, Symbol>> string_fields;
+};
+
+static uint32_t writer_append(AstFileWriter* writer, size_t size, size_t alignment)
+{
+	size_t position = (writer->data.size() + alignment - 1) & ~(alignment - 1);
+	writer->data.resize(position + size, 0);
+	return (uint32_t)position;
+}
+
+static void writer_set_pointer(AstFileWriter* writer, uint32_t field, uint32_t target)
+{
+	int32_t offset = (int32_t)(target - field);
+	memcpy(writer->data.data() + field, &offset, sizeof(offset));
+}
+
+static void writer_set_string(AstFileWriter* writer, uint32_t field, Symbol symbol)
+{
+	if (symbol != SYMBOL_NONE)
+		writer->string_fields.push_back({ field, symbol });
+}
+
+template<typename T>
+static T* writer_at(AstFileWriter* writer, uint32_t position)
+{
+	return (T*)(writer->data.data() + position);
+}
+
+static void write_type(AstFileWriter* writer, uint32_t position, const TypeDescriptor& type)
+{
+	AstFileType* record = writer_at<AstFileType>(writer, position);
+	record->base_type = (uint32_t)type.base_type;
+	record->ptr_count = type.ptr_count;
+	writer_set_string(writer, position + offsetof(AstFileType, type_name), type.type_name);
+}
+
+//Writes the tree in pre-order, pointing each parent's child field at the child once the child has a position.
+//Returns the number of nodes written
+static uint32_t write_tree(AstFileWriter* writer, const Node* tree, uint32_t root_field)
+{
+	uint32_t node_count = 0;
+	struct Pending
+	{
+		const Node* node;
+		uint32_t field;
+	};
+	std::vector<Pending> stack;
+	if (tree)
+		stack.push_back({ .node = tree, .field = root_field });
+
+	while (!stack.empty())
+	{
+		Pending pending = stack.back();
+		stack.pop_back();
+		const Node* node = pending.node;
+
+		uint32_t position = writer_append(writer, sizeof(AstFileNode), alignof(AstFileNode));
+		writer_set_pointer(writer, pending.field, position);
+		node_count++;
+
+		AstFileNode* record = writer_at<AstFileNode>(writer, position);
+		record->type = (uint8_t)node->type;
+		record->paren = node->paren;
+		switch (node->type)
+		{
+		case NodeType::INT_LITERAL:
+			record->parsed_int = node->value.parsed_int;
+			break;
+		case NodeType::IDENTIFIER:
+		case NodeType::CALL:
+		case NodeType::VARDECL:
+			writer_set_string(writer, position + offsetof(AstFileNode, name), node->value.name);
+			break;
+		}
+
+		if (node->type == NodeType::VARDECL)
+		{
+			uint32_t type = writer_append(writer, sizeof(AstFileType), alignof(AstFileType));
+			writer_set_pointer(writer, position + offsetof(AstFileNode, var_type), type);
+			write_type(writer, type, node->type_descriptor);
+		}
+
+		if (node->right)
+			stack.push_back({ .node = node->right, .field = position + (uint32_t)offsetof(AstFileNode, right) });
+		if (node->left)
+			stack.push_back({ .node = node->left, .field = position + (uint32_t)offsetof(AstFileNode, left) });
+	}
+	return node_count;
+}
+
+//Writes the functions with the bodies of source_file, or only their signatures if it is null. name is the file or
+//module being written, for error messages
+static bool write_file(const char* name, Symbol module_name, std::vector<FunctionDescriptor>& functions, SourceFile* source_file, const char* filepath)
+{
+	AstFileWriter writer;
+	uint32_t header = writer_append(&writer, sizeof(AstFileHeader), alignof(AstFileHeader));
+	uint32_t function_array = writer_append(&writer, sizeof(AstFileFunction) * functions.size(), alignof(AstFileFunction));
+
+	AstFileHeader* header_record = writer_at<AstFileHeader>(&writer, header);
+	memcpy(header_record->magic, AST_FILE_MAGIC, sizeof(header_record->magic));
+	header_record->version = AST_FILE_VERSION;
+	header_record->function_count = (uint32_t)functions.size();
+	header_record->flags = source_file ? 0 : AST_FILE_SIGNATURES_ONLY;
+	writer_set_string(&writer, header + offsetof(AstFileHeader, module_name), module_name);
+	if (!functions.empty())
+		writer_set_pointer(&writer, header + offsetof(AstFileHeader, functions), function_array);
+
+	for (size_t i = 0; i < functions.size(); i++)
+	{
+		FunctionDescriptor* function = &functions[i];
+		Node* node = nullptr;
+		if (source_file && !function_node(source_file, function, &node))
+			return false;
+
+		uint32_t position = function_array + (uint32_t)(i * sizeof(AstFileFunction));
+		writer_set_string(&writer, position + offsetof(AstFileFunction, name), function->name);
+		writer_at<AstFileFunction>(&writer, position)->parameter_count = (uint32_t)function->parameters.size();
+		writer_at<AstFileFunction>(&writer, position)->has_this = function->has_this;
+		write_type(&writer, position + offsetof(AstFileFunction, return_type), function->return_type);
+		write_type(&writer, position + offsetof(AstFileFunction, this_type), function->this_type_descriptor);
+
+		if (!function->parameters.empty())
+		{
+			uint32_t parameters = writer_append(&writer, sizeof(AstFileParameter) * function->parameters.size(), alignof(AstFileParameter));
+			writer_set_pointer(&writer, position + offsetof(AstFileFunction, parameters), parameters);
+			for (size_t p = 0; p < function->parameters.size(); p++)
+			{
+				uint32_t parameter = parameters + (uint32_t)(p * sizeof(AstFileParameter));
+				writer_set_string(&writer, parameter + offsetof(AstFileParameter, name), function->parameters[p].name);
+				write_type(&writer, parameter + offsetof(AstFileParameter, type), function->parameters[p].type_descriptor);
+			}
+		}
+
+		uint32_t node_count = write_tree(&writer, node, position + offsetof(AstFileFunction, body));
+		writer_at<AstFileFunction>(&writer, position)->node_count = node_count;
+	}
+
+	//Every distinct name is written once
+	std::unordered_map<Symbol, uint32_t> strings;
+	for (const std::pair<uint32_t, Symbol>& field : writer.string_fields)
+	{
+		auto existing = strings.find(field.second);
+		uint32_t position;
+		if (existing != strings.end())
+		{
+			position = existing->second;
+		}
+		else
+		{
+			size_t length = symbol_length(field.second);
+			position = writer_append(&writer, offsetof(AstFileString, data) + length + 1, alignof(AstFileString));
+			writer_at<AstFileString>(&writer, position)->length = (uint32_t)length;
+			memcpy(writer_at<AstFileString>(&writer, position)->data, symbol_name(field.second), length);
+			strings[field.second] = position;
+		}
+		writer_set_pointer(&writer, field.first, position);
+	}
+
+	writer_append(&writer, 0, 8);
+	if (writer.data.size() > INT32_MAX)
+	{
+		printf("AST of %s is too large to write\n", name);
+		return false;
+	}
+	writer_at<AstFileHeader>(&writer, header)->file_size = (uint32_t)writer.data.size();
+
+	FILE* file = fopen(filepath, "wb");
+	if (!file)
+	{
+		printf("Failed to open file %s\n", filepath);
+		return false;
+	}
+	bool result = fwrite(writer.data.data(), 1, writer.data.size(), file) == writer.data.size();
+	if (fclose(file))
+		result = false;
+	if (!result)
+		printf("Failed to write file %s\n", filepath);
+	return result;
+}
+
+//Writes every function of the file along with its tree. Lazy bodies are parsed first
+bool ast_file_write(SourceFile* source_file, const char* filepath)
+{
+	if (source_file->linearized)
+	{
+		printf("%s has been linearized and no longer has trees to write\n", source_file->filepath);
+		return false;
+	}
+	return write_file(source_file->filepath, SYMBOL_NONE, source_file->functions.functions, source_file, filepath);
+}
+
+//Writes the signatures of the functions without any bodies, as the interface of a module
+bool ast_file_write_interface(const char* module_name, std::vector<FunctionDescriptor>& functions, const char* filepath)
+{
+	return write_file(module_name, intern(module_name), functions, nullptr, filepath);
+}
+
+//Maps an AST file and checks its header. Nothing is copied, the records are used straight from the mapping
+bool ast_file_open(AstFile* file, const char* filepath)
+{
+	*file = {};
+	file->filepath = filepath;
+	if (!source_buffer_open(&file->buffer, file->filepath.c_str()))
+	{
+		file->filepath.clear();
+		return false;
+	}
+
+	const AstFileHeader* header = (const AstFileHeader*)file->buffer.data;
+	if (file->buffer.length < sizeof(AstFileHeader) || memcmp(header->magic, AST_FILE_MAGIC, sizeof(header->magic)))
+	{
+		printf("%s is not an AST file\n", filepath);
+		ast_file_close(file);
+		return false;
+	}
+	if (header->version != AST_FILE_VERSION)
+	{
+		printf("%s has AST file version %u, expected %u\n", filepath, header->version, AST_FILE_VERSION);
+		ast_file_close(file);
+		return false;
+	}
+
+	const char* functions = (const char*)header->functions.get();
+	size_t functions_end = functions ? functions - file->buffer.data + (size_t)header->function_count * sizeof(AstFileFunction) : 0;
+	if (header->file_size != file->buffer.length || (header->function_count && !functions) || functions_end > file->buffer.length)
+	{
+		printf("%s is truncated or corrupt\n", filepath);
+		ast_file_close(file);
+		return false;
+	}
+
+	file->header = header;
+	return true;
+}
+
+void ast_file_close(AstFile* file)
+{
+	source_buffer_close(&file->buffer);
+	file->header = nullptr;
+	file->filepath.clear();
+	file->filepath.shrink_to_fit();
+}
+
+const AstFileFunction* ast_file_function(const AstFile* file, uint32_t index)
+{
+	return file->header->functions.get() + index;
+}
+
+const char* ast_file_string(const RelativePointer<AstFileString>& string)
+{
+	const AstFileString* record = string.get();
+	return record ? record->data : nullptr;
+}
+
+static bool in_file(const AstFile* file, const void* record, size_t size)
+{
+	const char* begin = (const char*)record;
+	return begin >= file->buffer.data && begin + size <= file->buffer.data + file->buffer.length;
+}
+
+static bool load_symbol(const AstFile* file, const RelativePointer<AstFileString>& string, Symbol* symbol)
+{
+	const AstFileString* record = string.get();
+	if (!record)
+	{
+		*symbol = SYMBOL_NONE;
+		return true;
+	}
+	if (!in_file(file, record, offsetof(AstFileString, data)) || !in_file(file, record->data, (size_t)record->length + 1))
+		return false;
+	*symbol = intern(record->data, record->length);
+	return true;
+}
+
+static bool load_type(const AstFile* file, const AstFileType* record, TypeDescriptor* type)
+{
+	type->base_type = (BaseType)record->base_type;
+	type->ptr_count = record->ptr_count;
+	return load_symbol(file, record->type_name, &type->type_name);
+}
+
+//Rebuilds a pointer tree from the records, checking every reference stays inside the file. The writer puts every
+//node after its parent, so a child pointing backwards or more nodes than the function records mean the file is
+//corrupt, and a loop or shared records cannot make the loader run away
+static bool load_tree(const AstFile* file, const AstFileNode* root, uint32_t node_count, NodeAllocator* node_allocator, Node** tree)
+{
+	struct Pending
+	{
+		const AstFileNode* record;
+		Node* parent;
+		bool is_left;
+	};
+	std::vector<Pending> stack;
+	*tree = nullptr;
+	if (root)
+		stack.push_back({ .record = root });
+
+	while (!stack.empty())
+	{
+		Pending pending = stack.back();
+		stack.pop_back();
+		const AstFileNode* record = pending.record;
+		if (!node_count-- || !in_file(file, record, sizeof(AstFileNode)))
+			return false;
+
+		NodeType type = (NodeType)record->type;
+		Node* node = node_alloc(node_allocator);
+		*node = {
+			.type = type,
+			.precedence = node_precedence(type),
+			.parent = pending.parent,
+			.paren = record->paren != 0
+		};
+
+		switch (type)
+		{
+		case NodeType::INT_LITERAL:
+			node->value.parsed_int = (long)record->parsed_int;
+			break;
+		case NodeType::IDENTIFIER:
+		case NodeType::CALL:
+		case NodeType::VARDECL:
+			if (!load_symbol(file, record->name, &node->value.name))
+				return false;
+			break;
+		}
+
+		const AstFileType* var_type = record->var_type.get();
+		if (var_type && (!in_file(file, var_type, sizeof(AstFileType)) || !load_type(file, var_type, &node->type_descriptor)))
+			return false;
+
+		if (!pending.parent)
+			*tree = node;
+		else if (pending.is_left)
+			pending.parent->left = node;
+		else
+			pending.parent->right = node;
+
+		if (record->left.offset < 0 || record->right.offset < 0)
+			return false;
+		if (record->right.get())
+			stack.push_back({ .record = record->right.get(), .parent = node, .is_left = false });
+		if (record->left.get())
+			stack.push_back({ .record = record->left.get(), .parent = node, .is_left = true });
+	}
+	return true;
+}
+
+//Interns the name of the module a module interface belongs to, SYMBOL_NONE for other files
+bool ast_file_module_name(const AstFile* file, Symbol* name)
+{
+	if (load_symbol(file, file->header->module_name, name))
+		return true;
+	printf("%s: module name is corrupt\n", file->buffer.filepath);
+	return false;
+}
+
+//Rebuilds the signature of a function, leaving its body alone
+bool ast_file_load_declaration(const AstFile* file, uint32_t index, FunctionDescriptor* function)
+{
+	const AstFileFunction* record = ast_file_function(file, index);
+	*function = {};
+	function->has_this = record->has_this != 0;
+	bool result = load_symbol(file, record->name, &function->name) &&
+		load_type(file, &record->return_type, &function->return_type) &&
+		load_type(file, &record->this_type, &function->this_type_descriptor);
+
+	const AstFileParameter* parameters = record->parameters.get();
+	if (record->parameter_count && !in_file(file, parameters, (size_t)record->parameter_count * sizeof(AstFileParameter)))
+		result = false;
+	for (uint32_t i = 0; result && i < record->parameter_count; i++)
+	{
+		FunctionParameter parameter = {};
+		result = load_symbol(file, parameters[i].name, &parameter.name) &&
+			load_type(file, &parameters[i].type, &parameter.type_descriptor);
+		function->parameters.push_back(parameter);
+	}
+
+	if (!result)
+		printf("%s: function %u is corrupt\n", file->buffer.filepath, index);
+	return result;
+}
+
+//Rebuilds the body of a function into the allocator
+bool ast_file_load_body(const AstFile* file, uint32_t index, NodeAllocator* node_allocator, Node** tree)
+{
+	const AstFileFunction* record = ast_file_function(file, index);
+	bool result = load_tree(file, record->body.get(), record->node_count, node_allocator, tree);
+	if (!result)
+		printf("%s: function %u is corrupt\n", file->buffer.filepath, index);
+	return result;
+}
+
+//Rebuilds a FunctionDescriptor and its tree, for code which wants the parser's own structures rather than using
+//the records in place
+bool ast_file_load_function(const AstFile* file, uint32_t index, NodeAllocator* node_allocator, FunctionDescriptor* function)
+{
+	return ast_file_load_declaration(file, index, function) && ast_file_load_body(file, index, node_allocator, &function->node);
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <stdint.h>
+#include "ast.h"
+#include "source.h"
+#include <string>
+
+struct SourceFile;
+
+#define AST_FILE_MAGIC "NCAS"
+#define AST_FILE_VERSION 3
+
+//Set in the header of module interfaces, which hold function signatures with null bodies
+#define AST_FILE_SIGNATURES_ONLY 1
+
+//Offset from the pointer itself to its target, zero for null. Everything in an AST file refers to other parts of
+//it this way, so a mapped file can be used in place wherever it ends up in memory
+template<typename T>
+struct RelativePointer
+{
+	int32_t offset;
+
+	const T* get() const
+	{
+		return offset ? (const T*)((const char*)this + offset) : nullptr;
+	}
+};
+
+struct AstFileString
+{
+	uint32_t length;
+	//Followed by the characters and a terminating zero
+	char data[1];
+};
+
+struct AstFileType
+{
+	uint32_t base_type;
+	int32_t ptr_count;
+	RelativePointer<AstFileString> type_name;
+};
+
+struct AstFileNode
+{
+	uint8_t type;
+	uint8_t paren;
+	uint16_t unused;
+	RelativePointer<AstFileNode> left;
+	RelativePointer<AstFileNode> right;
+	//Only set for declarations
+	RelativePointer<AstFileType> var_type;
+	union
+	{
+		int64_t parsed_int;
+		RelativePointer<AstFileString> name;
+	};
+};
+
+struct AstFileParameter
+{
+	RelativePointer<AstFileString> name;
+	AstFileType type;
+};
+
+struct AstFileFunction
+{
+	RelativePointer<AstFileString> name;
+	RelativePointer<AstFileParameter> parameters;
+	uint32_t parameter_count;
+	uint32_t has_this;
+	AstFileType return_type;
+	AstFileType this_type;
+	RelativePointer<AstFileNode> body;
+	//Nodes in the body, so a corrupt file which shares or repeats records cannot make the loader build more
+	uint32_t node_count;
+};
+
+//The header is followed by the function array and then the nodes, types and strings they refer to. All records
+//are 8 byte aligned and little endian
+struct AstFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t file_size;
+	uint32_t function_count;
+	RelativePointer<AstFileFunction> functions;
+	uint32_t flags;
+	//Name of the module whose interface this is, null for other files
+	RelativePointer<AstFileString> module_name;
+};
+
+struct AstFile
+{
+	//Copy of the path the buffer refers to for error messages, so callers need not keep theirs alive
+	std::string filepath;
+	SourceBuffer buffer;
+	const AstFileHeader* header = nullptr;
+};
+
+extern bool ast_file_write(SourceFile* source_file, const char* filepath);
+extern bool ast_file_write_interface(const char* module_name, std::vector<FunctionDescriptor>& functions, const char* filepath);
+extern bool ast_file_open(AstFile* file, const char* filepath);
+extern void ast_file_close(AstFile* file);
+extern const AstFileFunction* ast_file_function(const AstFile* file, uint32_t index);
+extern const char* ast_file_string(const RelativePointer<AstFileString>& string);
+extern bool ast_file_module_name(const AstFile* file, Symbol* name);
+extern bool ast_file_load_declaration(const AstFile* file, uint32_t index, FunctionDescriptor* function);
+extern bool ast_file_load_body(const AstFile* file, uint32_t index, NodeAllocator* node_allocator, Node** tree);
+extern bool ast_file_load_function(const AstFile* file, uint32_t index, NodeAllocator* node_allocator, FunctionDescriptor* function);
@@ -0,0 +1,664 @@
+#include "bench.h"
+#include "tokenize.h"
+#include "source.h"
+#include "ast.h"
+#include "parser.h"
+#include "compact_ast.h"
+#include "ir.h"
+#include "strength_reduce.h"
+#include "register_allocator.h"
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool token_streams_equal(const TokenStream& a, const TokenStream& b)
+{
+	return a.types == b.types &&
+		a.offsets == b.offsets &&
+		!memcmp(a.payloads.data(), b.payloads.data(), a.payloads.size() * sizeof(TokenPayload));
+}
+
+static const char* scan_mode_name(ScanMode mode)
+{
+	switch (mode)
+	{
+	case ScanMode::SCALAR:
+		return "scalar";
+	case ScanMode::SSE2:
+		return "sse2";
+	case ScanMode::AVX2:
+		return "avx2";
+	}
+	return "unknown";
+}
+
+//Lexes the file repeatedly with every scan mode the cpu supports and reports throughput. The token streams
+//of the SIMD modes are checked against the scalar one
+bool bench_lexer(const char* filepath)
+{
+	SourceBuffer source;
+	if (!source_buffer_open(&source, filepath))
+		return false;
+
+	ScanMode previous_mode = tokenize_scan_mode();
+	TokenStream reference;
+	bool result = true;
+
+	for (int m = (int)ScanMode::SCALAR; m <= (int)scan_mode_best(); m++)
+	{
+		ScanMode mode = tokenize_set_scan_mode((ScanMode)m);
+
+		TokenStream tokens;
+		if (!tokenize_buffer(source.data, source.length, tokens))
+		{
+			result = false;
+			break;
+		}
+		if (mode == ScanMode::SCALAR)
+			reference = tokens;
+		else if (!token_streams_equal(reference, tokens))
+		{
+			printf("%s token stream differs from scalar\n", scan_mode_name(mode));
+			result = false;
+		}
+
+		int iterations = 0;
+		auto start = std::chrono::steady_clock::now();
+		do
+		{
+			TokenStream t;
+			tokenize_buffer(source.data, source.length, t);
+			iterations++;
+		} while (seconds_since(start) < 1.0);
+		double seconds = seconds_since(start);
+
+		printf("%-8s %8.3f GB/s  (%i iterations, %zu tokens)\n", scan_mode_name(mode),
+			(double)source.length * iterations / seconds / 1e9, iterations, tokens.types.size());
+	}
+
+	tokenize_set_scan_mode(previous_mode);
+	source_buffer_close(&source);
+	return result;
+}
+
+//Lexes the file with an increasing number of threads, up to max_threads or one per core, and reports the speedup
+//over a single thread
+bool bench_lexer_threads(const char* filepath, int max_threads)
+{
+	SourceBuffer source;
+	if (!source_buffer_open(&source, filepath))
+		return false;
+
+	if (max_threads <= 0)
+		max_threads = (int)std::thread::hardware_concurrency();
+
+	TokenStream reference;
+	if (!tokenize_buffer(source.data, source.length, reference))
+	{
+		source_buffer_close(&source);
+		return false;
+	}
+
+	bool result = true;
+	double single_thread_seconds = 0;
+	for (int threads = 1; threads <= max_threads; threads *= 2)
+	{
+		TokenStream tokens;
+		tokenize_buffer_parallel(source.data, source.length, tokens, threads);
+		if (!token_streams_equal(reference, tokens))
+		{
+			printf("%i thread token stream differs from serial\n", threads);
+			result = false;
+		}
+
+		int iterations = 0;
+		auto start = std::chrono::steady_clock::now();
+		do
+		{
+			TokenStream t;
+			tokenize_buffer_parallel(source.data, source.length, t, threads);
+			iterations++;
+		} while (seconds_since(start) < 1.0);
+		double seconds = seconds_since(start) / iterations;
+		if (threads == 1)
+			single_thread_seconds = seconds;
+
+		printf("%3i threads %8.3f GB/s  %5.2fx\n", threads, source.length / seconds / 1e9, single_thread_seconds / seconds);
+
+		if (threads < max_threads && threads * 2 > max_threads)
+			threads = max_threads / 2;
+	}
+
+	source_buffer_close(&source);
+	return result;
+}
+
+//Builds a function whose body is a single expression of the given number of operands
+static std::string expression_source(const char* shape, int operands)
+{
+	static const char* binary[] = { " + ", " * ", " - ", " = ", ", " };
+	std::string source = "f : () {\nx = ";
+	int open_parens = 0;
+	for (int i = 0; i < operands; i++)
+	{
+		if (i > 0)
+			source += strcmp(shape, "chain") ? binary[i % 5] : " + ";
+		if (!strcmp(shape, "nested") && i + 1 < operands)
+		{
+			source += "(";
+			open_parens++;
+		}
+		if (!strcmp(shape, "unary"))
+			source += i % 2 ? "*&" : "*";
+		source += i % 3 ? "a" : "17";
+		if (!strcmp(shape, "nested") && open_parens == 64)
+		{
+			source.append(open_parens, ')');
+			open_parens = 0;
+		}
+	}
+	source.append(open_parens, ')');
+	source += ";\n}\n";
+	return source;
+}
+
+//Parses single expressions of increasing length in a few shapes and reports the time per token, which should
+//stay flat as the expressions grow
+bool bench_expressions(int max_operands)
+{
+	static const char* shapes[] = { "chain", "mixed", "nested", "unary" };
+	if (max_operands <= 0)
+		max_operands = 1000000;
+
+	NodeAllocator* allocator = node_allocator_create();
+	bool result = true;
+	for (const char* shape : shapes)
+	{
+		for (int operands = 1000; operands <= max_operands; operands *= 10)
+		{
+			std::string source = expression_source(shape, operands);
+			TokenStream tokens;
+			if (!tokenize_buffer(source.data(), source.size(), tokens))
+			{
+				result = false;
+				continue;
+			}
+
+			int iterations = 0;
+			auto start = std::chrono::steady_clock::now();
+			do
+			{
+				FunctionDescriptor function = {};
+				int next;
+				if (!parse_function(tokens, 0, allocator, &function, &next))
+				{
+					printf("%s expression of %i operands failed to parse\n", shape, operands);
+					result = false;
+					break;
+				}
+				node_allocator_reset(allocator);
+				iterations++;
+			} while (seconds_since(start) < 0.5);
+			double seconds = seconds_since(start) / iterations;
+
+			printf("%-7s %8i operands %8.2f ms  %6.2f ns/token\n", shape, operands, seconds * 1e3,
+				seconds * 1e9 / tokens.size());
+		}
+	}
+
+	node_allocator_free(allocator);
+	return result;
+}
+
+static bool trees_equal(const Node* a, const Node* b)
+{
+	if (!a || !b)
+		return a == b;
+	return a->type == b->type &&
+		a->value.parsed_int == b->value.parsed_int &&
+		a->paren == b->paren &&
+		a->type_descriptor.base_type == b->type_descriptor.base_type &&
+		a->type_descriptor.type_name == b->type_descriptor.type_name &&
+		a->type_descriptor.ptr_count == b->type_descriptor.ptr_count &&
+		trees_equal(a->left, b->left) &&
+		trees_equal(a->right, b->right);
+}
+
+static void reset_source_file(SourceFile* source_file)
+{
+	for (NodeAllocator* allocator : source_file->node_allocators)
+		if (allocator)
+			node_allocator_reset(allocator);
+	function_table_clear(&source_file->functions);
+}
+
+//Parses the functions of the file with an increasing number of threads, up to max_threads or one per core, and
+//reports the speedup over a single thread. Every run is checked against the trees of the serial parse
+bool bench_parser_threads(const char* filepath, int max_threads)
+{
+	SourceFile reference = { .filepath = filepath };
+	if (!source_buffer_open(&reference.source, filepath))
+		return false;
+	reference.tokens.source = &reference.source;
+	if (!tokenize_buffer(reference.source.data, reference.source.length, reference.tokens))
+	{
+		report_error(&reference.source, reference.tokens.error_offset, "Encountered unexpected token");
+		source_buffer_close(&reference.source);
+		return false;
+	}
+
+	ParserContext serial;
+	init_context(&serial);
+	if (!parse_source_file(&serial, &reference))
+	{
+		source_buffer_close(&reference.source);
+		return false;
+	}
+
+	if (max_threads <= 0)
+		max_threads = (int)std::thread::hardware_concurrency();
+
+	bool result = true;
+	double single_thread_seconds = 0;
+	for (int threads = 1; threads <= max_threads; threads *= 2)
+	{
+		ParserContext ctx;
+		init_context(&ctx);
+		ctx.parser_threads = threads;
+		SourceFile source_file = { .filepath = filepath, .tokens = reference.tokens };
+
+		int iterations = 0;
+		auto start = std::chrono::steady_clock::now();
+		do
+		{
+			reset_source_file(&source_file);
+			if (!parse_source_file(&ctx, &source_file))
+			{
+				result = false;
+				break;
+			}
+			iterations++;
+		} while (seconds_since(start) < 1.0);
+		double seconds = seconds_since(start) / iterations;
+		if (threads == 1)
+			single_thread_seconds = seconds;
+
+		const std::vector<FunctionDescriptor>& expected = reference.functions.functions;
+		const std::vector<FunctionDescriptor>& actual = source_file.functions.functions;
+		bool same = expected.size() == actual.size();
+		for (size_t i = 0; same && i < expected.size(); i++)
+			same = expected[i].name == actual[i].name && trees_equal(expected[i].node, actual[i].node);
+		if (!same)
+		{
+			printf("%i thread parse differs from serial\n", threads);
+			result = false;
+		}
+
+		printf("%3i threads %8.2f ms  %5.2fx  (%zu functions)\n", threads, seconds * 1e3, single_thread_seconds / seconds, actual.size());
+
+		reset_source_file(&source_file);
+		for (NodeAllocator* allocator : source_file.node_allocators)
+			if (allocator)
+				node_allocator_free(allocator);
+		free_context(&ctx);
+
+		if (threads < max_threads && threads * 2 > max_threads)
+			threads = max_threads / 2;
+	}
+
+	for (NodeAllocator* allocator : reference.node_allocators)
+		if (allocator)
+			node_allocator_free(allocator);
+	function_table_clear(&reference.functions);
+	source_buffer_close(&reference.source);
+	return result;
+}
+
+//Times lexing the file on its own, lexing plus indexing the function declarations with lazy bodies, and lexing
+//plus a full parse
+bool bench_indexing(const char* filepath)
+{
+	SourceBuffer source;
+	if (!source_buffer_open(&source, filepath))
+		return false;
+
+	static const char* stages[] = { "lex", "index", "parse" };
+	bool result = true;
+	for (int stage = 0; stage < 3 && result; stage++)
+	{
+		ParserContext ctx;
+		init_context(&ctx);
+		ctx.lazy_bodies = stage == 1;
+
+		int iterations = 0;
+		size_t function_count = 0;
+		auto start = std::chrono::steady_clock::now();
+		do
+		{
+			SourceFile source_file = { .filepath = filepath };
+			source_file.tokens.source = &source;
+			if (!tokenize_buffer(source.data, source.length, source_file.tokens))
+			{
+				report_error(&source, source_file.tokens.error_offset, "Encountered unexpected token");
+				result = false;
+				break;
+			}
+			if (stage > 0 && !parse_source_file(&ctx, &source_file))
+			{
+				result = false;
+				break;
+			}
+
+			function_count = source_file.functions.functions.size();
+			for (NodeAllocator* allocator : source_file.node_allocators)
+				if (allocator)
+					node_allocator_free(allocator);
+			function_table_clear(&source_file.functions);
+			iterations++;
+		} while (seconds_since(start) < 1.0);
+		double seconds = seconds_since(start) / iterations;
+
+		printf("%-6s %8.2f ms  %8.3f GB/s  (%zu functions)\n", stages[stage], seconds * 1e3, source.length / seconds / 1e9, function_count);
+		free_context(&ctx);
+	}
+
+	source_buffer_close(&source);
+	return result;
+}
+
+static bool compact_equal(const Node* node, const CompactTree* tree, NodeIndex index)
+{
+	if (!node || index == NODE_INDEX_NONE)
+		return !node && index == NODE_INDEX_NONE;
+
+	const CompactNode* compact = &tree->nodes[index];
+	const TypeDescriptor* type = compact_type(tree, index);
+	if (node->type == NodeType::VARDECL && (!type ||
+		type->base_type != node->type_descriptor.base_type ||
+		type->type_name != node->type_descriptor.type_name ||
+		type->ptr_count != node->type_descriptor.ptr_count))
+		return false;
+
+	return compact->type == node->type &&
+		compact->value.parsed_int == node->value.parsed_int &&
+		(compact->flags & COMPACT_FLAG_PAREN) == (node->paren ? COMPACT_FLAG_PAREN : 0) &&
+		compact_equal(node->left, tree, compact->left) &&
+		compact_equal(node->right, tree, compact->right);
+}
+
+//Converts every function of the file to the compact node layout, checks the trees match and compares the memory
+//taken by both layouts
+bool bench_ast_memory(const char* filepath)
+{
+	ParserContext ctx;
+	init_context(&ctx);
+	if (!parse_file(&ctx, filepath))
+		return false;
+
+	SourceFile* source_file = ctx.source_files[0];
+	size_t node_bytes = 0;
+	size_t compact_bytes = 0;
+	size_t node_count = 0;
+	bool result = true;
+
+	auto start = std::chrono::steady_clock::now();
+	for (FunctionDescriptor& function : source_file->functions.functions)
+	{
+		CompactTree tree;
+		compact_tree_build(&tree, function.node);
+		CompactTree post_order;
+		compact_tree_build(&post_order, function.node, NodeOrder::POST_ORDER);
+		if (!compact_equal(function.node, &tree, tree.root) || !compact_equal(function.node, &post_order, post_order.root))
+		{
+			printf("Compact tree of %s differs\n", symbol_name(function.name));
+			result = false;
+		}
+		node_count += tree.nodes.size() - 1;
+		compact_bytes += compact_tree_bytes(&tree);
+	}
+	double seconds = seconds_since(start);
+
+	for (NodeAllocator* allocator : source_file->node_allocators)
+		if (allocator)
+			node_bytes += allocator->bytes_used;
+
+	printf("%zu nodes\n", node_count);
+	printf("Node         %10zu bytes  %5.1f bytes/node\n", node_bytes, (double)node_bytes / node_count);
+	printf("CompactNode  %10zu bytes  %5.1f bytes/node  (%.2fx smaller)\n", compact_bytes, (double)compact_bytes / node_count,
+		(double)node_bytes / compact_bytes);
+	printf("Converted and checked in %.2f ms\n", seconds * 1e3);
+
+	free_context(&ctx);
+	return result;
+}
+
+static long sum_literals(const Node* node)
+{
+	if (!node)
+		return 0;
+	long sum = node->type == NodeType::INT_LITERAL ? node->value.parsed_int : 0;
+	return sum + sum_literals(node->left) + sum_literals(node->right);
+}
+
+//Sums the integer literals of every function, once by recursing over the parsed trees and once by scanning the
+//linearized ones, and reports the time taken by each walk
+bool bench_ast_walk(const char* filepath)
+{
+	ParserContext ctx;
+	init_context(&ctx);
+	if (!parse_file(&ctx, filepath))
+		return false;
+	SourceFile* source_file = ctx.source_files[0];
+
+	long pointer_sum = 0;
+	int iterations = 0;
+	auto start = std::chrono::steady_clock::now();
+	do
+	{
+		pointer_sum = 0;
+		for (FunctionDescriptor& function : source_file->functions.functions)
+			pointer_sum += sum_literals(function.node);
+		iterations++;
+	} while (seconds_since(start) < 1.0);
+	double pointer_seconds = seconds_since(start) / iterations;
+
+	start = std::chrono::steady_clock::now();
+	linearize_source_file(source_file);
+	double linearize_seconds = seconds_since(start);
+
+	long linear_sum = 0;
+	iterations = 0;
+	start = std::chrono::steady_clock::now();
+	do
+	{
+		linear_sum = 0;
+		for (const CompactTree& tree : source_file->trees)
+			for (const CompactNode& node : tree.nodes)
+				if (node.type == NodeType::INT_LITERAL)
+					linear_sum += node.value.parsed_int;
+		iterations++;
+	} while (seconds_since(start) < 1.0);
+	double linear_seconds = seconds_since(start) / iterations;
+
+	printf("pointer walk %8.2f ms\n", pointer_seconds * 1e3);
+	printf("linear scan  %8.2f ms  (%.2fx faster, linearizing took %.2f ms)\n", linear_seconds * 1e3,
+		pointer_seconds / linear_seconds, linearize_seconds * 1e3);
+
+	free_context(&ctx);
+	if (pointer_sum != linear_sum)
+	{
+		puts("Linearized trees give a different result");
+		return false;
+	}
+	return true;
+}
+
+//Lowers every function of the file to IR, checks it and compares its size with the pointer trees
+bool bench_ir(const char* filepath)
+{
+	ParserContext ctx;
+	init_context(&ctx);
+	if (!parse_file(&ctx, filepath))
+		return false;
+	SourceFile* source_file = ctx.source_files[0];
+
+	size_t node_bytes = 0;
+	for (NodeAllocator* allocator : source_file->node_allocators)
+		if (allocator)
+			node_bytes += allocator->bytes_used;
+
+	std::vector<IrFunction> functions(source_file->functions.functions.size());
+	bool result = true;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < functions.size(); i++)
+		if (!ir_lower_function(&source_file->functions.functions[i], source_file->functions.functions[i].node, &functions[i]))
+			result = false;
+	double seconds = seconds_since(start);
+
+	size_t instruction_count = 0;
+	size_t block_count = 0;
+	size_t ir_bytes = 0;
+	for (const IrFunction& function : functions)
+	{
+		if (!ir_verify(&function))
+			result = false;
+		instruction_count += function.instructions.size();
+		block_count += function.blocks.size();
+		ir_bytes += function.instructions.size() * sizeof(IrInstruction) + function.blocks.size() * sizeof(IrBlock) +
+			function.calls.size() * sizeof(IrCall) + function.arguments.size() * sizeof(IrRegister);
+	}
+
+	printf("%zu functions, %zu instructions in %zu blocks\n", functions.size(), instruction_count, block_count);
+	printf("Node trees  %10zu bytes\n", node_bytes);
+	printf("IR          %10zu bytes  (%.2fx smaller)\n", ir_bytes, (double)node_bytes / ir_bytes);
+	printf("Lowered in %.2f ms\n", seconds * 1e3);
+
+	free_context(&ctx);
+	return result;
+}
+
+//Lowers every function of the file and compares the cycle counts of the IR before and after strength reduction
+bool bench_strength_reduction(const char* filepath)
+{
+	ParserContext ctx;
+	init_context(&ctx);
+	if (!parse_file(&ctx, filepath))
+		return false;
+	SourceFile* source_file = ctx.source_files[0];
+
+	std::vector<IrFunction> functions(source_file->functions.functions.size());
+	bool result = true;
+	for (size_t i = 0; i < functions.size(); i++)
+		if (!ir_lower_function(&source_file->functions.functions[i], source_file->functions.functions[i].node, &functions[i]))
+			result = false;
+
+	size_t multiplies = 0;
+	uint64_t cycles_before = 0;
+	size_t instructions_before = 0;
+	for (const IrFunction& function : functions)
+	{
+		for (const IrInstruction& instruction : function.instructions)
+			if (instruction.op == IrOp::MUL)
+				multiplies++;
+		cycles_before += ir_function_cycles(&function);
+		instructions_before += function.instructions.size();
+	}
+
+	size_t reduced = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (IrFunction& function : functions)
+		reduced += reduce_multiplies(&function);
+	double seconds = seconds_since(start);
+
+	uint64_t cycles_after = 0;
+	size_t instructions_after = 0;
+	for (const IrFunction& function : functions)
+	{
+		if (!ir_verify(&function))
+			result = false;
+		cycles_after += ir_function_cycles(&function);
+		instructions_after += function.instructions.size();
+	}
+
+	printf("%zu of %zu multiplies replaced in %.2f ms\n", reduced, multiplies, seconds * 1e3);
+	printf("Instructions %10zu -> %zu\n", instructions_before, instructions_after);
+	printf("Cycles       %10llu -> %llu  (%.2fx fewer)\n", (unsigned long long)cycles_before,
+		(unsigned long long)cycles_after, (double)cycles_before / cycles_after);
+
+	free_context(&ctx);
+	return result;
+}
+
+//Lowers every function of the file and allocates machine registers for it. Memory traffic is compared with keeping
+//every virtual register in memory, where each read is a load and each write a store
+bool bench_register_allocation(const char* filepath, uint32_t machine_registers)
+{
+	ParserContext ctx;
+	init_context(&ctx);
+	if (!parse_file(&ctx, filepath))
+		return false;
+	SourceFile* source_file = ctx.source_files[0];
+
+	std::vector<IrFunction> functions(source_file->functions.functions.size());
+	bool result = true;
+	for (size_t i = 0; i < functions.size(); i++)
+		if (!ir_lower_function(&source_file->functions.functions[i], source_file->functions.functions[i].node, &functions[i]))
+			result = false;
+
+	uint64_t memory_accesses = 0;
+	uint64_t unallocated_accesses = 0;
+	size_t registers = 0;
+	size_t moves = 0;
+	for (const IrFunction& function : functions)
+	{
+		registers += function.register_count;
+		unallocated_accesses += function.parameter_count;
+		for (const IrInstruction& instruction : function.instructions)
+		{
+			IrRegister uses[2];
+			unallocated_accesses += ir_uses(instruction, uses);
+			if (instruction.op == IrOp::CALL)
+				unallocated_accesses += function.calls[instruction.a].argument_count;
+			if (ir_defines(instruction.op))
+				unallocated_accesses++;
+			if (instruction.op == IrOp::LOAD || instruction.op == IrOp::STORE)
+				memory_accesses++;
+			if (instruction.op == IrOp::MOV)
+				moves++;
+		}
+	}
+
+	std::vector<IrAllocation> allocations(functions.size());
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < functions.size(); i++)
+		if (!allocate_registers(&functions[i], machine_registers, &allocations[i]))
+			result = false;
+	double seconds = seconds_since(start);
+
+	uint64_t spill_accesses = 0;
+	size_t spilled = 0;
+	size_t moves_removed = 0;
+	for (const IrAllocation& allocation : allocations)
+	{
+		spill_accesses += allocation.spill_loads + allocation.spill_stores;
+		spilled += allocation.spilled_registers;
+		moves_removed += allocation.moves_removed;
+	}
+
+	printf("%zu virtual registers in %u machine registers, allocated in %.2f ms\n", registers, machine_registers, seconds * 1e3);
+	printf("Spilled      %10zu registers\n", spilled);
+	printf("Moves        %10zu of %zu removed\n", moves_removed, moves);
+	printf("Memory ops   %10llu -> %llu  (%.2fx fewer)\n", (unsigned long long)(memory_accesses + unallocated_accesses),
+		(unsigned long long)(memory_accesses + spill_accesses),
+		(double)(memory_accesses + unallocated_accesses) / (memory_accesses + spill_accesses));
+
+	free_context(&ctx);
+	return result;
+}
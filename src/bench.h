@@ -0,0 +1,13 @@
+#pragma once
+#include <stdint.h>
+
+extern bool bench_lexer(const char* filepath);
+extern bool bench_lexer_threads(const char* filepath, int max_threads);
+extern bool bench_expressions(int max_operands);
+extern bool bench_parser_threads(const char* filepath, int max_threads);
+extern bool bench_indexing(const char* filepath);
+extern bool bench_ast_memory(const char* filepath);
+extern bool bench_ast_walk(const char* filepath);
+extern bool bench_ir(const char* filepath);
+extern bool bench_strength_reduction(const char* filepath);
+extern bool bench_register_allocation(const char* filepath, uint32_t machine_registers);
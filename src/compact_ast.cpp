@@ -0,0 +1,142 @@
+#include "compact_ast.h"
+
+static_assert(sizeof(CompactNode) <= 24, "CompactNode should stay under half the size of Node");
+
+static NodeIndex append_node(CompactTree* tree, const Node* node, NodeIndex parent)
+{
+	NodeIndex index = (NodeIndex)tree->nodes.size();
+	tree->nodes.push_back({
+		.type = node->type,
+		.flags = (uint8_t)(node->paren ? COMPACT_FLAG_PAREN : 0),
+		.parent = parent,
+		.value = node->value
+	});
+
+	if (node->type == NodeType::VARDECL)
+	{
+		tree->nodes[index].flags |= COMPACT_FLAG_TYPED;
+		tree->types.push_back({ .node = index, .type = node->type_descriptor });
+	}
+	return index;
+}
+
+static void build_pre_order(CompactTree* tree, const Node* root)
+{
+	struct Pending
+	{
+		const Node* node;
+		NodeIndex parent;
+		bool is_left;
+	};
+	std::vector<Pending> stack;
+	stack.push_back({ .node = root, .parent = NODE_INDEX_NONE });
+
+	while (!stack.empty())
+	{
+		Pending pending = stack.back();
+		stack.pop_back();
+		const Node* node = pending.node;
+
+		NodeIndex index = append_node(tree, node, pending.parent);
+		if (pending.parent == NODE_INDEX_NONE)
+			tree->root = index;
+		else if (pending.is_left)
+			tree->nodes[pending.parent].left = index;
+		else
+			tree->nodes[pending.parent].right = index;
+
+		//Pushed in reverse so the left child is visited first
+		if (node->right)
+			stack.push_back({ .node = node->right, .parent = index, .is_left = false });
+		if (node->left)
+			stack.push_back({ .node = node->left, .parent = index, .is_left = true });
+	}
+}
+
+//A node is appended once both of its subtrees have been, at which point their roots are the newest entries of
+//the finished stack
+static void build_post_order(CompactTree* tree, const Node* root)
+{
+	struct Pending
+	{
+		const Node* node;
+		bool expanded;
+	};
+	std::vector<Pending> stack;
+	std::vector<NodeIndex> finished;
+	stack.push_back({ .node = root });
+
+	while (!stack.empty())
+	{
+		const Node* node = stack.back().node;
+		if (!stack.back().expanded)
+		{
+			stack.back().expanded = true;
+			if (node->right)
+				stack.push_back({ .node = node->right });
+			if (node->left)
+				stack.push_back({ .node = node->left });
+			continue;
+		}
+		stack.pop_back();
+
+		NodeIndex index = append_node(tree, node, NODE_INDEX_NONE);
+		CompactNode* compact = &tree->nodes[index];
+		if (node->right)
+		{
+			compact->right = finished.back();
+			finished.pop_back();
+			tree->nodes[compact->right].parent = index;
+		}
+		if (node->left)
+		{
+			compact->left = finished.back();
+			finished.pop_back();
+			tree->nodes[compact->left].parent = index;
+		}
+		finished.push_back(index);
+	}
+
+	tree->root = finished.back();
+}
+
+//Copies a pointer tree into the compact layout. The walks use explicit stacks so deep trees cannot overflow the
+//call stack
+void compact_tree_build(CompactTree* tree, const Node* root, NodeOrder order)
+{
+	tree->nodes.clear();
+	tree->types.clear();
+	tree->nodes.push_back({});
+	tree->root = NODE_INDEX_NONE;
+	tree->order = order;
+	if (!root)
+		return;
+
+	if (order == NodeOrder::POST_ORDER)
+		build_post_order(tree, root);
+	else
+		build_pre_order(tree, root);
+}
+
+const TypeDescriptor* compact_type(const CompactTree* tree, NodeIndex index)
+{
+	if (!(tree->nodes[index].flags & COMPACT_FLAG_TYPED))
+		return nullptr;
+
+	size_t low = 0;
+	size_t high = tree->types.size();
+	while (low < high)
+	{
+		size_t middle = (low + high) / 2;
+		if (tree->types[middle].node < index)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return &tree->types[low].type;
+}
+
+size_t compact_tree_bytes(const CompactTree* tree)
+{
+	return tree->nodes.size() * sizeof(CompactNode) + tree->types.size() * sizeof(CompactType);
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "ast.h"
+
+//Index of a node within its CompactTree. Index 0 is reserved so it can mean no node
+typedef uint32_t NodeIndex;
+
+#define NODE_INDEX_NONE 0
+
+#define COMPACT_FLAG_PAREN 1
+//The node has an entry in the tree's type table
+#define COMPACT_FLAG_TYPED 2
+
+//Node which refers to its neighbours by index instead of pointer and leaves out the fields only the parser needs.
+//Type information lives in a side table since only declarations carry any
+struct CompactNode
+{
+	NodeType type = NodeType::INVALID;
+	uint8_t flags = 0;
+	NodeIndex parent = NODE_INDEX_NONE;
+	NodeIndex left = NODE_INDEX_NONE;
+	NodeIndex right = NODE_INDEX_NONE;
+	TokenPayload value = {};
+};
+
+struct CompactType
+{
+	NodeIndex node = NODE_INDEX_NONE;
+	TypeDescriptor type;
+};
+
+enum class NodeOrder
+{
+	PRE_ORDER,
+	//Children come before their parent and the root is last, so a pass can handle every node in one forward scan
+	//with the results for its children already computed
+	POST_ORDER,
+};
+
+//All nodes of one tree in a single array, in the order it was built in. The type table is sorted by node index
+struct CompactTree
+{
+	std::vector<CompactNode> nodes;
+	std::vector<CompactType> types;
+	NodeIndex root = NODE_INDEX_NONE;
+	NodeOrder order = NodeOrder::PRE_ORDER;
+};
+
+extern void compact_tree_build(CompactTree* tree, const Node* root, NodeOrder order = NodeOrder::PRE_ORDER);
+extern const TypeDescriptor* compact_type(const CompactTree* tree, NodeIndex index);
+extern size_t compact_tree_bytes(const CompactTree* tree);
+
+inline CompactNode* compact_node(CompactTree* tree, NodeIndex index)
+{
+	return &tree->nodes[index];
+}
@@ -0,0 +1,317 @@
+#include "constant_fold.h"
+#include <vector>
+
+struct FoldFrame
+{
+	Node** slot;
+	Node* parent;
+	bool expanded;
+};
+
+//Operand of an ADD/SUB chain, or factor of a MUL chain
+struct ChainTerm
+{
+	Node* node;
+	bool negative;
+};
+
+struct Chain
+{
+	//Operands which are not literals, in evaluation order
+	std::vector<ChainTerm> operands;
+	//The operator nodes of the chain, reused when it is rebuilt
+	std::vector<Node*> operators;
+	//First literal of the chain, reused to hold the folded constant
+	Node* literal;
+	int literal_count;
+	//Sum or product of the literals, wrapped to 16 bits
+	uint16_t constant;
+	//Terms still to visit while collecting
+	std::vector<ChainTerm> stack;
+};
+
+static bool is_additive(const Node* node)
+{
+	return node && (node->type == NodeType::ADD || node->type == NodeType::SUBTRACT);
+}
+
+static bool is_multiplicative(const Node* node)
+{
+	return node && node->type == NodeType::MULTIPLY;
+}
+
+//True if evaluating the tree can do anything besides produce its value
+bool has_side_effects(const Node* tree)
+{
+	std::vector<const Node*> stack;
+	if (tree)
+		stack.push_back(tree);
+	while (!stack.empty())
+	{
+		const Node* node = stack.back();
+		stack.pop_back();
+		switch (node->type)
+		{
+		case NodeType::CALL:
+		case NodeType::ASSIGN:
+		case NodeType::VARDECL:
+		case NodeType::IF:
+			return true;
+		}
+		if (node->left)
+			stack.push_back(node->left);
+		if (node->right)
+			stack.push_back(node->right);
+	}
+	return false;
+}
+
+static size_t count_nodes(const Node* tree)
+{
+	size_t count = 0;
+	std::vector<const Node*> stack;
+	if (tree)
+		stack.push_back(tree);
+	while (!stack.empty())
+	{
+		const Node* node = stack.back();
+		stack.pop_back();
+		count++;
+		if (node->left)
+			stack.push_back(node->left);
+		if (node->right)
+			stack.push_back(node->right);
+	}
+	return count;
+}
+
+//Collects the operands of the ADD/SUB or MUL nodes reachable from root without passing through anything else,
+//in evaluation order. Subtracted operands are marked negative
+static void collect_chain(Node* root, bool multiplicative, Chain* chain)
+{
+	chain->operands.clear();
+	chain->operators.clear();
+	chain->literal = nullptr;
+	chain->literal_count = 0;
+	chain->constant = multiplicative ? 1 : 0;
+	std::vector<ChainTerm>& stack = chain->stack;
+	stack.push_back({ .node = root });
+	while (!stack.empty())
+	{
+		ChainTerm term = stack.back();
+		stack.pop_back();
+		Node* node = term.node;
+		if (multiplicative ? is_multiplicative(node) : is_additive(node))
+		{
+			chain->operators.push_back(node);
+			stack.push_back({ .node = node->right, .negative = term.negative != (node->type == NodeType::SUBTRACT) });
+			stack.push_back({ .node = node->left, .negative = term.negative });
+			continue;
+		}
+
+		if (node->type != NodeType::INT_LITERAL)
+		{
+			chain->operands.push_back(term);
+			continue;
+		}
+		uint16_t value = (uint16_t)node->value.parsed_int;
+		if (multiplicative)
+			chain->constant = (uint16_t)(chain->constant * value);
+		else
+			chain->constant += term.negative ? (uint16_t)-value : value;
+		if (chain->literal_count++ == 0)
+			chain->literal = node;
+	}
+}
+
+static Node* make_literal(Node* node, uint16_t value)
+{
+	*node = {
+		.type = NodeType::INT_LITERAL,
+		.precedence = node_precedence(NodeType::INT_LITERAL),
+		.value = { .parsed_int = (int16_t)value }
+	};
+	return node;
+}
+
+static Node* make_operator(Node* node, NodeType type, Node* left, Node* right)
+{
+	*node = {
+		.type = type,
+		.precedence = node_precedence(type),
+		.left = left,
+		.right = right
+	};
+	left->parent = node;
+	right->parent = node;
+	return node;
+}
+
+//The folded constant is needed unless it is the identity of the chain. A sum whose first operand is subtracted
+//keeps it anyway, to subtract from
+static bool needs_constant(const Chain* chain, bool multiplicative)
+{
+	if (chain->operands.empty())
+		return true;
+	if (multiplicative)
+		return chain->constant != 1;
+	return chain->constant != 0 || chain->operands[0].negative;
+}
+
+//Rebuilds the chain from its operands in their original order followed by the folded constant, or led by it when
+//the first operand of a sum is subtracted. Returns the new root
+static Node* rebuild_chain(Chain* chain, bool multiplicative)
+{
+	size_t next_operator = 0;
+	Node* root = nullptr;
+	bool constant = needs_constant(chain, multiplicative);
+	bool constant_first = constant && (chain->operands.empty() || (!multiplicative && chain->operands[0].negative));
+	if (constant_first)
+		root = make_literal(chain->literal, chain->constant);
+
+	for (const ChainTerm& operand : chain->operands)
+	{
+		if (!root)
+		{
+			root = operand.node;
+			continue;
+		}
+		NodeType type = multiplicative ? NodeType::MULTIPLY : operand.negative ? NodeType::SUBTRACT : NodeType::ADD;
+		root = make_operator(chain->operators[next_operator++], type, root, operand.node);
+	}
+
+	if (constant && !constant_first)
+	{
+		//A negative constant is subtracted so the sum reads naturally
+		int16_t value = (int16_t)chain->constant;
+		NodeType type = multiplicative ? NodeType::MULTIPLY : NodeType::ADD;
+		if (!multiplicative && value < 0 && value != INT16_MIN)
+		{
+			type = NodeType::SUBTRACT;
+			value = -value;
+		}
+		root = make_operator(chain->operators[next_operator++], type, root, make_literal(chain->literal, (uint16_t)value));
+	}
+	return root;
+}
+
+//Folds the ADD/SUB or MUL chain whose root is at slot, collecting it into chain. Returns the number of nodes removed
+static size_t fold_chain(Node** slot, bool multiplicative, Chain* work)
+{
+	Node* root = *slot;
+	Chain& chain = *work;
+	collect_chain(root, multiplicative, &chain);
+	if (chain.literal_count == 0)
+		return 0;
+
+	bool paren = root->paren;
+	Node* parent = root->parent;
+
+	//A product of zero is zero if the other factors have nothing else to do
+	bool pure = multiplicative && chain.constant == 0 && !chain.operands.empty();
+	for (size_t i = 0; pure && i < chain.operands.size(); i++)
+		pure = !has_side_effects(chain.operands[i].node);
+	if (pure)
+	{
+		size_t removed = count_nodes(root) - 1;
+		*slot = make_literal(root, 0);
+		(*slot)->paren = paren;
+		(*slot)->parent = parent;
+		return removed;
+	}
+
+	//Every literal after the first goes, and the first as well if the constant is not needed. Each operand
+	//removed takes an operator with it
+	size_t removed_literals = chain.literal_count - (needs_constant(&chain, multiplicative) ? 1 : 0);
+	if (removed_literals == 0)
+		return 0;
+
+	Node* result = rebuild_chain(&chain, multiplicative);
+	result->paren = paren;
+	result->parent = parent;
+	*slot = result;
+	return removed_literals * 2;
+}
+
+//*&x is x and &*p is p. Neither is folded where the difference between a variable and a value matters: *&v
+//stays when its address is taken or it is assigned to and v is not itself a variable, and &*p stays as an
+//assignment target or under another &
+static bool fold_reference(Node** slot, const Node* parent)
+{
+	Node* node = *slot;
+	Node* inner = node->right;
+	if (!inner || !inner->right)
+		return false;
+
+	bool address_used = parent && (parent->type == NodeType::REFERENCE || (parent->type == NodeType::ASSIGN && parent->left == node));
+	if (node->type == NodeType::DEREFERECE && inner->type == NodeType::REFERENCE)
+	{
+		NodeType type = inner->right->type;
+		if (address_used && type != NodeType::IDENTIFIER && type != NodeType::VARDECL && type != NodeType::DEREFERECE)
+			return false;
+	}
+	else if (node->type != NodeType::REFERENCE || inner->type != NodeType::DEREFERECE || address_used)
+	{
+		return false;
+	}
+
+	Node* result = inner->right;
+	result->parent = node->parent;
+	*slot = result;
+	return true;
+}
+
+//Folds arithmetic on literals with the target's 16 bit wraparound, drops additions of zero and multiplications by
+//one, replaces side effect free products with zero by zero and removes *& and &* pairs. Chains of additions or
+//multiplications are folded as a whole, so constants separated by other operands still meet. Operands with side
+//effects keep their order. Returns the number of nodes removed
+size_t fold_constants(Node** tree)
+{
+	size_t removed = 0;
+	Chain chain;
+	std::vector<FoldFrame> stack;
+	stack.push_back({ .slot = tree });
+	while (!stack.empty())
+	{
+		FoldFrame& frame = stack.back();
+		Node* node = *frame.slot;
+		if (!node)
+		{
+			stack.pop_back();
+			continue;
+		}
+		if (!frame.expanded)
+		{
+			frame.expanded = true;
+			if (node->right)
+				stack.push_back({ .slot = &node->right, .parent = node });
+			if (node->left)
+				stack.push_back({ .slot = &node->left, .parent = node });
+			continue;
+		}
+
+		Node** slot = frame.slot;
+		Node* parent = frame.parent;
+		stack.pop_back();
+		switch (node->type)
+		{
+		case NodeType::ADD:
+		case NodeType::SUBTRACT:
+			//Operators inside a longer chain are folded along with its root
+			if (!is_additive(parent))
+				removed += fold_chain(slot, false, &chain);
+			break;
+		case NodeType::MULTIPLY:
+			if (!is_multiplicative(parent))
+				removed += fold_chain(slot, true, &chain);
+			break;
+		case NodeType::REFERENCE:
+		case NodeType::DEREFERECE:
+			//A pair removed here can expose another, as in *&*&x
+			while (*slot && fold_reference(slot, parent))
+				removed += 2;
+			break;
+		}
+	}
+	return removed;
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <stddef.h>
+#include "ast.h"
+
+extern bool has_side_effects(const Node* tree);
+extern size_t fold_constants(Node** tree);
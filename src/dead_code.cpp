@@ -0,0 +1,291 @@
+#include "dead_code.h"
+#include <algorithm>
+#include <unordered_set>
+#include <vector>
+
+//Statement list of a function body or an IF arm. The arms of its IF statements are simplified before it
+struct ScopeFrame
+{
+	Node** slot;
+	Node* parent;
+	bool expanded;
+};
+
+struct Eliminator
+{
+	//Nodes taken out of the tree. They are reused to link the statements which are left, so the tree never needs
+	//new nodes
+	std::vector<Node*> spare;
+	size_t removed;
+	//Work lists kept between statements and scopes so they are allocated once per function
+	std::vector<Node*> stack;
+	std::vector<Node*> parts;
+	std::vector<Node*> arm;
+	std::vector<Node*> statements;
+	std::vector<Node*> kept;
+	std::unordered_set<Symbol> later;
+};
+
+static void discard(Eliminator* eliminator, Node* node)
+{
+	eliminator->spare.push_back(node);
+	eliminator->removed++;
+}
+
+static void discard_tree(Eliminator* eliminator, Node* tree)
+{
+	std::vector<Node*>& stack = eliminator->stack;
+	if (tree)
+		stack.push_back(tree);
+	while (!stack.empty())
+	{
+		Node* node = stack.back();
+		stack.pop_back();
+		if (node->left)
+			stack.push_back(node->left);
+		if (node->right)
+			stack.push_back(node->right);
+		discard(eliminator, node);
+	}
+}
+
+static Node* take_spare(Eliminator* eliminator)
+{
+	Node* node = eliminator->spare.back();
+	eliminator->spare.pop_back();
+	eliminator->removed--;
+	return node;
+}
+
+//Appends the statements of the EXP_SEQUENCE chain at head in order. The sequence nodes are discarded, the chain is
+//linked again once the statements are simplified
+static void collect_statements(Eliminator* eliminator, Node* head, std::vector<Node*>* statements)
+{
+	size_t first = statements->size();
+	while (head && head->type == NodeType::EXP_SEQUENCE)
+	{
+		statements->push_back(head->right);
+		discard(eliminator, head);
+		head = head->left;
+	}
+	if (head)
+		statements->push_back(head);
+	std::reverse(statements->begin() + first, statements->end());
+}
+
+static void add_names(Eliminator* eliminator, Node* tree, std::unordered_set<Symbol>* names)
+{
+	std::vector<Node*>& stack = eliminator->stack;
+	stack.push_back(tree);
+	while (!stack.empty())
+	{
+		const Node* node = stack.back();
+		stack.pop_back();
+		if (node->type == NodeType::IDENTIFIER || node->type == NodeType::VARDECL)
+			names->insert(node->value.name);
+		if (node->left)
+			stack.push_back(node->left);
+		if (node->right)
+			stack.push_back(node->right);
+	}
+}
+
+//True if the tree declares any of the names, nested arms included
+static bool declares_any(Eliminator* eliminator, Node* tree, const std::unordered_set<Symbol>* names)
+{
+	std::vector<Node*>& stack = eliminator->stack;
+	stack.push_back(tree);
+	while (!stack.empty())
+	{
+		const Node* node = stack.back();
+		stack.pop_back();
+		if (node->type == NodeType::VARDECL && names->count(node->value.name))
+		{
+			stack.clear();
+			return true;
+		}
+		if (node->left)
+			stack.push_back(node->left);
+		if (node->right)
+			stack.push_back(node->right);
+	}
+	return false;
+}
+
+//Pushes the parts of an expression statement which do something onto kept, last first since statements are
+//simplified from the end. Its value is never used, so arithmetic, references, dereferences, names and literals
+//are dropped and the calls, assignments and declarations under them stay in evaluation order
+static void keep_effects(Eliminator* eliminator, Node* expression, std::vector<Node*>* kept)
+{
+	std::vector<Node*>& parts = eliminator->parts;
+	std::vector<Node*>& stack = eliminator->stack;
+	parts.clear();
+	stack.push_back(expression);
+	while (!stack.empty())
+	{
+		Node* node = stack.back();
+		stack.pop_back();
+		switch (node->type)
+		{
+		case NodeType::CALL:
+		case NodeType::ASSIGN:
+		case NodeType::VARDECL:
+		case NodeType::IF:
+			parts.push_back(node);
+			break;
+		case NodeType::ADD:
+		case NodeType::SUBTRACT:
+		case NodeType::MULTIPLY:
+		case NodeType::COMMA:
+		case NodeType::REFERENCE:
+		case NodeType::DEREFERECE:
+			if (node->right)
+				stack.push_back(node->right);
+			if (node->left)
+				stack.push_back(node->left);
+			discard(eliminator, node);
+			break;
+		default:
+			discard(eliminator, node);
+			break;
+		}
+	}
+	kept->insert(kept->end(), parts.rbegin(), parts.rend());
+}
+
+//Pushes what is left of an IF statement onto kept. An arm behind a constant condition replaces the IF, unless it
+//declares a name which the statements after it use, in which case it stays an arm so the declaration keeps its
+//scope. An IF without arms leaves its condition
+static void simplify_if(Eliminator* eliminator, Node* node, std::vector<Node*>* kept, const std::unordered_set<Symbol>* later)
+{
+	Node* condition = node->left;
+	Node* branch = node->right;
+	if (!condition || !branch || branch->type != NodeType::IF_BRANCH)
+	{
+		kept->push_back(node);
+		return;
+	}
+
+	if (condition->type != NodeType::INT_LITERAL)
+	{
+		if (branch->left || branch->right)
+		{
+			kept->push_back(node);
+			return;
+		}
+		discard(eliminator, node);
+		discard(eliminator, branch);
+		keep_effects(eliminator, condition, kept);
+		return;
+	}
+
+	bool then_taken = (int16_t)condition->value.parsed_int != 0;
+	Node* taken = then_taken ? branch->left : branch->right;
+	discard_tree(eliminator, then_taken ? branch->right : branch->left);
+	if (taken && declares_any(eliminator, taken, later))
+	{
+		condition->value.parsed_int = 1;
+		branch->left = taken;
+		branch->right = nullptr;
+		kept->push_back(node);
+		return;
+	}
+
+	discard(eliminator, node);
+	discard(eliminator, branch);
+	discard(eliminator, condition);
+	std::vector<Node*>& statements = eliminator->arm;
+	statements.clear();
+	collect_statements(eliminator, taken, &statements);
+	kept->insert(kept->end(), statements.rbegin(), statements.rend());
+}
+
+//Simplifies the statements of one list from the last to the first, so the names used after each statement are
+//known when it is reached, and links what is left into a new chain
+static void simplify_scope(Eliminator* eliminator, Node** slot, Node* parent)
+{
+	std::vector<Node*>& statements = eliminator->statements;
+	statements.clear();
+	collect_statements(eliminator, *slot, &statements);
+
+	//The names used later are only needed to splice arms in
+	bool constant_condition = false;
+	for (const Node* statement : statements)
+		if (statement->type == NodeType::IF && statement->left && statement->left->type == NodeType::INT_LITERAL)
+			constant_condition = true;
+
+	std::vector<Node*>& kept = eliminator->kept;
+	std::unordered_set<Symbol>& later = eliminator->later;
+	kept.clear();
+	if (constant_condition)
+		later.clear();
+	for (size_t i = statements.size(); i-- > 0;)
+	{
+		size_t first = kept.size();
+		if (statements[i]->type == NodeType::IF)
+			simplify_if(eliminator, statements[i], &kept, &later);
+		else
+			keep_effects(eliminator, statements[i], &kept);
+		for (size_t k = first; constant_condition && k < kept.size(); k++)
+			add_names(eliminator, kept[k], &later);
+	}
+
+	Node* head = nullptr;
+	for (size_t i = kept.size(); i-- > 0;)
+	{
+		Node* statement = kept[i];
+		if (!head)
+		{
+			head = statement;
+			continue;
+		}
+		Node* sequence = take_spare(eliminator);
+		*sequence = {
+			.type = NodeType::EXP_SEQUENCE,
+			.left = head,
+			.right = statement
+		};
+		head->parent = sequence;
+		statement->parent = sequence;
+		head = sequence;
+	}
+	if (head)
+		head->parent = parent;
+	*slot = head;
+}
+
+//Removes IF arms behind constant conditions, IF statements with no arms and expression statements, or the parts of
+//them, which have no side effects. The language has no jumps besides IF, so the dropped arms are the only
+//unreachable code. Conditions are only recognized as constant once they are a literal, so fold_constants should
+//run first. Returns the number of nodes removed
+size_t eliminate_dead_code(Node** tree)
+{
+	Eliminator eliminator = {};
+	std::vector<ScopeFrame> stack;
+	stack.push_back({ .slot = tree, .parent = *tree ? (*tree)->parent : nullptr });
+	while (!stack.empty())
+	{
+		ScopeFrame frame = stack.back();
+		if (frame.expanded)
+		{
+			stack.pop_back();
+			simplify_scope(&eliminator, frame.slot, frame.parent);
+			continue;
+		}
+
+		stack.back().expanded = true;
+		Node* head = *frame.slot;
+		while (head)
+		{
+			Node* statement = head->type == NodeType::EXP_SEQUENCE ? head->right : head;
+			Node* branch = statement->type == NodeType::IF ? statement->right : nullptr;
+			if (branch && branch->type == NodeType::IF_BRANCH)
+			{
+				stack.push_back({ .slot = &branch->left, .parent = branch });
+				stack.push_back({ .slot = &branch->right, .parent = branch });
+			}
+			head = head->type == NodeType::EXP_SEQUENCE ? head->left : nullptr;
+		}
+	}
+	return eliminator.removed;
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include <stddef.h>
+#include "ast.h"
+
+extern size_t eliminate_dead_code(Node** tree);
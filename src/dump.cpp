@@ -0,0 +1,410 @@
+#include "dump.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static void dump_flush(DumpWriter* writer)
+{
+	if (writer->used && fwrite(writer->buffer, 1, writer->used, writer->file) != writer->used)
+		writer->failed = true;
+	writer->used = 0;
+}
+
+static void dump_write(DumpWriter* writer, const char* data, size_t length)
+{
+	if (writer->used + length > DUMP_BUFFER_SIZE)
+	{
+		dump_flush(writer);
+		if (length > DUMP_BUFFER_SIZE)
+		{
+			if (fwrite(data, 1, length, writer->file) != length)
+				writer->failed = true;
+			return;
+		}
+	}
+	memcpy(writer->buffer + writer->used, data, length);
+	writer->used += length;
+}
+
+static void dump_string(DumpWriter* writer, const char* str)
+{
+	dump_write(writer, str, strlen(str));
+}
+
+static void dump_repeat(DumpWriter* writer, char c, size_t count)
+{
+	while (count)
+	{
+		if (writer->used == DUMP_BUFFER_SIZE)
+			dump_flush(writer);
+		size_t length = DUMP_BUFFER_SIZE - writer->used;
+		if (length > count)
+			length = count;
+		memset(writer->buffer + writer->used, c, length);
+		writer->used += length;
+		count -= length;
+	}
+}
+
+static void dump_long(DumpWriter* writer, long value)
+{
+	char digits[24];
+	int length = 0;
+	unsigned long magnitude = value < 0 ? 0ul - (unsigned long)value : (unsigned long)value;
+	do
+	{
+		digits[sizeof(digits) - 1 - length++] = (char)('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude);
+	if (value < 0)
+		digits[sizeof(digits) - 1 - length++] = '-';
+	dump_write(writer, digits + sizeof(digits) - length, length);
+}
+
+static void dump_symbol(DumpWriter* writer, Symbol symbol)
+{
+	if (symbol != SYMBOL_NONE)
+		dump_write(writer, symbol_name(symbol), symbol_length(symbol));
+}
+
+static const char* node_type_name(NodeType type)
+{
+	switch (type)
+	{
+	case NodeType::INT_LITERAL:
+		return "INT_LITERAL";
+	case NodeType::IDENTIFIER:
+		return "IDENTIFIER";
+	case NodeType::REFERENCE:
+		return "REFERENCE";
+	case NodeType::DEREFERECE:
+		return "DEREFERENCE";
+	case NodeType::MULTIPLY:
+		return "MULTIPLY";
+	case NodeType::ADD:
+		return "ADD";
+	case NodeType::SUBTRACT:
+		return "SUBTRACT";
+	case NodeType::ASSIGN:
+		return "ASSIGN";
+	case NodeType::VARDECL:
+		return "VARDECL";
+	case NodeType::EXP_SEQUENCE:
+		return "EXP_SEQUENCE";
+	case NodeType::COMMA:
+		return "COMMA";
+	case NodeType::CALL:
+		return "CALL";
+	case NodeType::IF:
+		return "IF";
+	case NodeType::IF_BRANCH:
+		return "IF_BRANCH";
+	}
+	return "INVALID";
+}
+
+static const char* base_type_name(BaseType type)
+{
+	switch (type)
+	{
+	case BaseType::U8:
+		return "u8";
+	case BaseType::U16:
+		return "u16";
+	case BaseType::S16:
+		return "s16";
+	case BaseType::VOID:
+		return "void";
+	case BaseType::STRUCT:
+		return "struct";
+	case BaseType::NOT_EVALUATED:
+		return "not_evaluated";
+	}
+	return "invalid";
+}
+
+static void dump_text_label(DumpWriter* writer, const Node* node)
+{
+	switch (node->type)
+	{
+	case NodeType::INT_LITERAL:
+		dump_long(writer, node->value.parsed_int);
+		break;
+	case NodeType::IDENTIFIER:
+		dump_symbol(writer, node->value.name);
+		break;
+	case NodeType::ASSIGN:
+		dump_string(writer, "=");
+		break;
+	case NodeType::VARDECL:
+		dump_string(writer, "decl");
+		break;
+	case NodeType::REFERENCE:
+		dump_string(writer, "ref");
+		break;
+	case NodeType::DEREFERECE:
+		dump_string(writer, "deref");
+		break;
+	case NodeType::MULTIPLY:
+		dump_string(writer, "*");
+		break;
+	case NodeType::ADD:
+		dump_string(writer, "+");
+		break;
+	case NodeType::SUBTRACT:
+		dump_string(writer, "-");
+		break;
+	case NodeType::COMMA:
+		dump_string(writer, ",");
+		break;
+	case NodeType::CALL:
+		dump_symbol(writer, node->value.name);
+		dump_string(writer, "()");
+		break;
+	case NodeType::EXP_SEQUENCE:
+		dump_string(writer, "seq");
+		break;
+	case NodeType::IF:
+		dump_string(writer, "IF");
+		break;
+	case NodeType::IF_BRANCH:
+		dump_string(writer, "IF_BRANCH");
+		break;
+	}
+}
+
+//Reverse in-order walk: the right subtree, then the node, then the left subtree, each child one tab deeper
+static void dump_text_tree(DumpWriter* writer, const Node* tree, int depth)
+{
+	struct Pending
+	{
+		const Node* node;
+		int depth;
+		bool expanded;
+	};
+	std::vector<Pending> stack;
+	if (tree)
+		stack.push_back({ .node = tree, .depth = depth });
+
+	while (!stack.empty())
+	{
+		Pending pending = stack.back();
+		stack.pop_back();
+		if (!pending.expanded)
+		{
+			if (pending.node->left)
+				stack.push_back({ .node = pending.node->left, .depth = pending.depth + 1 });
+			stack.push_back({ .node = pending.node, .depth = pending.depth, .expanded = true });
+			if (pending.node->right)
+				stack.push_back({ .node = pending.node->right, .depth = pending.depth + 1 });
+			continue;
+		}
+
+		dump_repeat(writer, '\t', pending.depth);
+		dump_text_label(writer, pending.node);
+		dump_write(writer, "\n", 1);
+	}
+}
+
+static void dump_json_type(DumpWriter* writer, const TypeDescriptor* type)
+{
+	dump_string(writer, "{\"base_type\":\"");
+	dump_string(writer, base_type_name(type->base_type));
+	dump_string(writer, "\"");
+	if (type->type_name != SYMBOL_NONE)
+	{
+		dump_string(writer, ",\"type_name\":\"");
+		dump_symbol(writer, type->type_name);
+		dump_string(writer, "\"");
+	}
+	dump_string(writer, ",\"ptr_count\":");
+	dump_long(writer, type->ptr_count);
+	dump_string(writer, "}");
+}
+
+//Writes the fields of a node up to but not including its children and closing brace. Identifiers only ever hold
+//letters, digits and underscores so names need no escaping
+static void dump_json_node_open(DumpWriter* writer, const Node* node)
+{
+	dump_string(writer, "{\"type\":\"");
+	dump_string(writer, node_type_name(node->type));
+	dump_string(writer, "\"");
+
+	switch (node->type)
+	{
+	case NodeType::INT_LITERAL:
+		dump_string(writer, ",\"value\":");
+		dump_long(writer, node->value.parsed_int);
+		break;
+	case NodeType::IDENTIFIER:
+	case NodeType::CALL:
+	case NodeType::VARDECL:
+		dump_string(writer, ",\"name\":\"");
+		dump_symbol(writer, node->value.name);
+		dump_string(writer, "\"");
+		break;
+	}
+
+	if (node->type == NodeType::VARDECL)
+	{
+		dump_string(writer, ",\"var_type\":");
+		dump_json_type(writer, &node->type_descriptor);
+	}
+	if (node->paren)
+		dump_string(writer, ",\"paren\":true");
+}
+
+//Pre-order walk which writes each node's fields on the way down and its closing brace once both children are done
+static void dump_json_tree(DumpWriter* writer, const Node* tree)
+{
+	if (!tree)
+	{
+		dump_string(writer, "null");
+		return;
+	}
+
+	struct Pending
+	{
+		const Node* node;
+		int state;
+	};
+	std::vector<Pending> stack;
+	stack.push_back({ .node = tree });
+
+	while (!stack.empty())
+	{
+		Pending& pending = stack.back();
+		const Node* node = pending.node;
+		switch (pending.state++)
+		{
+		case 0:
+			dump_json_node_open(writer, node);
+			if (node->left)
+			{
+				dump_string(writer, ",\"left\":");
+				stack.push_back({ .node = node->left });
+			}
+			break;
+		case 1:
+			if (node->right)
+			{
+				dump_string(writer, ",\"right\":");
+				stack.push_back({ .node = node->right });
+			}
+			break;
+		default:
+			dump_string(writer, "}");
+			stack.pop_back();
+			break;
+		}
+	}
+}
+
+static void dump_json_separator(DumpWriter* writer)
+{
+	dump_string(writer, writer->count ? ",\n" : "\n");
+	writer->count++;
+}
+
+//Opens a dump to filepath, or to stdout if filepath is null or "-"
+bool dump_open(DumpWriter* writer, const char* filepath, DumpFormat format)
+{
+	*writer = { .format = format };
+	if (!filepath || !strcmp(filepath, "-"))
+	{
+		writer->file = stdout;
+	}
+	else
+	{
+		writer->file = fopen(filepath, "w");
+		if (!writer->file)
+		{
+			printf("Failed to open file for tree printing %s\n", filepath);
+			return false;
+		}
+		writer->owns_file = true;
+	}
+
+	writer->buffer = (char*)malloc(DUMP_BUFFER_SIZE);
+	if (format == DumpFormat::JSON)
+		dump_string(writer, "[");
+	return true;
+}
+
+void dump_tree(DumpWriter* writer, const Node* tree)
+{
+	if (writer->format == DumpFormat::JSON)
+	{
+		dump_json_separator(writer);
+		dump_json_tree(writer, tree);
+		return;
+	}
+	dump_text_tree(writer, tree, 0);
+}
+
+//Dumps a function's signature followed by its body
+void dump_function(DumpWriter* writer, const FunctionDescriptor* function, const Node* tree)
+{
+	if (writer->format == DumpFormat::TEXT)
+	{
+		dump_string(writer, "fn ");
+		dump_symbol(writer, function->name);
+		dump_write(writer, "\n", 1);
+		dump_text_tree(writer, tree, 1);
+		return;
+	}
+
+	dump_json_separator(writer);
+	dump_string(writer, "{\"name\":\"");
+	dump_symbol(writer, function->name);
+	dump_string(writer, "\",\"parameters\":[");
+	for (size_t i = 0; i < function->parameters.size(); i++)
+	{
+		dump_string(writer, i ? ",{\"name\":\"" : "{\"name\":\"");
+		dump_symbol(writer, function->parameters[i].name);
+		dump_string(writer, "\",\"type\":");
+		dump_json_type(writer, &function->parameters[i].type_descriptor);
+		dump_string(writer, "}");
+	}
+	dump_string(writer, "],\"return_type\":");
+	dump_json_type(writer, &function->return_type);
+	if (function->has_this)
+	{
+		dump_string(writer, ",\"this_type\":");
+		dump_json_type(writer, &function->this_type_descriptor);
+	}
+	dump_string(writer, ",\"body\":");
+	dump_json_tree(writer, tree);
+	dump_string(writer, "}");
+}
+
+//Finishes the dump and closes the file. Returns false if anything failed to write
+bool dump_close(DumpWriter* writer)
+{
+	if (writer->format == DumpFormat::JSON)
+		dump_string(writer, "\n]\n");
+	dump_flush(writer);
+	if (writer->owns_file)
+	{
+		if (fclose(writer->file))
+			writer->failed = true;
+	}
+	else
+	{
+		fflush(writer->file);
+	}
+	free(writer->buffer);
+	writer->buffer = nullptr;
+	return !writer->failed;
+}
+
+void print_tree(const char* filepath, const Node* tree)
+{
+	if (filepath == nullptr)
+		filepath = "/code/ast.txt";
+	DumpWriter writer;
+	if (!dump_open(&writer, filepath, DumpFormat::TEXT))
+		return;
+	dump_tree(&writer, tree);
+	dump_close(&writer);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdio.h>
+#include "ast.h"
+
+#define DUMP_BUFFER_SIZE (1024 * 1024)
+
+enum class DumpFormat
+{
+	//Indented tree with the right child above its parent and the left child below, one node per line
+	TEXT,
+	//A JSON array with one element per dumped tree or function
+	JSON,
+};
+
+//Buffered writer for AST dumps. Trees are walked with an explicit stack so any depth can be dumped
+struct DumpWriter
+{
+	FILE* file = nullptr;
+	bool owns_file = false;
+	DumpFormat format = DumpFormat::TEXT;
+	char* buffer = nullptr;
+	size_t used = 0;
+	//Number of elements written to the JSON array so far
+	size_t count = 0;
+	bool failed = false;
+};
+
+extern bool dump_open(DumpWriter* writer, const char* filepath, DumpFormat format);
+extern void dump_tree(DumpWriter* writer, const Node* tree);
+extern void dump_function(DumpWriter* writer, const FunctionDescriptor* function, const Node* tree);
+extern bool dump_close(DumpWriter* writer);
+extern void print_tree(const char* filepath, const Node* tree);
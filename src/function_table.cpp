@@ -0,0 +1,69 @@
+#include "function_table.h"
+#include <stdlib.h>
+
+#define FUNCTION_TABLE_INITIAL_CAPACITY 64
+
+//Symbols are small sequential integers, so a multiplicative hash is enough to spread them over the slots
+static uint32_t function_slot(Symbol name, uint32_t capacity)
+{
+	return (name * 2654435761u) & (capacity - 1);
+}
+
+static void function_table_grow(FunctionTable* table)
+{
+	uint32_t capacity = table->capacity ? table->capacity * 2 : FUNCTION_TABLE_INITIAL_CAPACITY;
+	uint32_t* slots = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+	for (uint32_t i = 0; i < (uint32_t)table->functions.size(); i++)
+	{
+		uint32_t slot = function_slot(table->functions[i].name, capacity);
+		while (slots[slot])
+			slot = (slot + 1) & (capacity - 1);
+		slots[slot] = i + 1;
+	}
+	free(table->slots);
+	table->slots = slots;
+	table->capacity = capacity;
+}
+
+//Returns false without adding anything if a function with the same name is already in the table
+bool function_table_add(FunctionTable* table, const FunctionDescriptor& function)
+{
+	if ((table->functions.size() + 1) * 2 > table->capacity)
+		function_table_grow(table);
+
+	uint32_t slot = function_slot(function.name, table->capacity);
+	while (table->slots[slot])
+	{
+		if (table->functions[table->slots[slot] - 1].name == function.name)
+			return false;
+		slot = (slot + 1) & (table->capacity - 1);
+	}
+
+	table->functions.push_back(function);
+	table->slots[slot] = (uint32_t)table->functions.size();
+	return true;
+}
+
+FunctionDescriptor* function_table_find(FunctionTable* table, Symbol name)
+{
+	if (!table->capacity)
+		return nullptr;
+
+	uint32_t slot = function_slot(name, table->capacity);
+	while (table->slots[slot])
+	{
+		FunctionDescriptor* function = &table->functions[table->slots[slot] - 1];
+		if (function->name == name)
+			return function;
+		slot = (slot + 1) & (table->capacity - 1);
+	}
+	return nullptr;
+}
+
+void function_table_clear(FunctionTable* table)
+{
+	table->functions.clear();
+	free(table->slots);
+	table->slots = nullptr;
+	table->capacity = 0;
+}
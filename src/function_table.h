@@ -0,0 +1,18 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "ast.h"
+
+//Functions of one source file stored contiguously in declaration order, with an open addressing index keyed by
+//the interned name. Pointers returned by function_table_find are invalidated by function_table_add
+struct FunctionTable
+{
+	std::vector<FunctionDescriptor> functions;
+	//Slots hold the function index plus one so zero can mark an empty slot
+	uint32_t* slots = nullptr;
+	uint32_t capacity = 0;
+};
+
+extern bool function_table_add(FunctionTable* table, const FunctionDescriptor& function);
+extern FunctionDescriptor* function_table_find(FunctionTable* table, Symbol name);
+extern void function_table_clear(FunctionTable* table);
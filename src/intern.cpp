@@ -0,0 +1,151 @@
+#include "intern.h"
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+
+//The table is split into independently locked shards so tokenizer threads rarely contend. A symbol encodes the
+//shard in its low bits and the index of the entry within the shard above them
+#define INTERN_SHARD_BITS 6
+#define INTERN_SHARD_COUNT (1 << INTERN_SHARD_BITS)
+#define INTERN_PAGE_BITS 10
+#define INTERN_PAGE_SIZE (1 << INTERN_PAGE_BITS)
+#define INTERN_MAX_PAGES 1024
+#define INTERN_INITIAL_CAPACITY 256
+
+struct InternEntry
+{
+	const char* name;
+	uint32_t length;
+	uint32_t hash;
+};
+
+struct InternShard
+{
+	std::mutex mutex;
+	Arena* strings = nullptr;
+	uint32_t* table = nullptr;
+	uint32_t capacity = 0;
+	uint32_t count = 0;
+	//Entries live in fixed size pages which never move, so symbol_name can read them without taking the lock
+	InternEntry* pages[INTERN_MAX_PAGES] = {};
+};
+
+static InternShard shards[INTERN_SHARD_COUNT];
+
+static uint32_t intern_hash(const char* str, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= (uint8_t)str[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static InternEntry* shard_entry(InternShard* shard, uint32_t index)
+{
+	return &shard->pages[index >> INTERN_PAGE_BITS][index & (INTERN_PAGE_SIZE - 1)];
+}
+
+static Symbol make_symbol(uint32_t shard, uint32_t index)
+{
+	return ((index << INTERN_SHARD_BITS) | shard) + 1;
+}
+
+static InternEntry* symbol_entry(Symbol symbol)
+{
+	uint32_t value = symbol - 1;
+	return shard_entry(&shards[value & (INTERN_SHARD_COUNT - 1)], value >> INTERN_SHARD_BITS);
+}
+
+//Table slots hold the entry index plus one so zero can mark an empty slot
+static void shard_grow(InternShard* shard)
+{
+	uint32_t capacity = shard->capacity ? shard->capacity * 2 : INTERN_INITIAL_CAPACITY;
+	uint32_t* table = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+	for (uint32_t i = 0; i < shard->count; i++)
+	{
+		uint32_t slot = (shard_entry(shard, i)->hash >> INTERN_SHARD_BITS) & (capacity - 1);
+		while (table[slot])
+			slot = (slot + 1) & (capacity - 1);
+		table[slot] = i + 1;
+	}
+	free(shard->table);
+	shard->table = table;
+	shard->capacity = capacity;
+}
+
+Symbol intern(const char* str, size_t length)
+{
+	uint32_t hash = intern_hash(str, length);
+	uint32_t shard_index = hash & (INTERN_SHARD_COUNT - 1);
+	InternShard* shard = &shards[shard_index];
+	std::lock_guard<std::mutex> lock(shard->mutex);
+
+	if (shard->count * 2 >= shard->capacity)
+		shard_grow(shard);
+
+	uint32_t slot = (hash >> INTERN_SHARD_BITS) & (shard->capacity - 1);
+	while (shard->table[slot])
+	{
+		uint32_t index = shard->table[slot] - 1;
+		InternEntry* entry = shard_entry(shard, index);
+		if (entry->hash == hash && entry->length == length && !memcmp(entry->name, str, length))
+			return make_symbol(shard_index, index);
+		slot = (slot + 1) & (shard->capacity - 1);
+	}
+
+	uint32_t index = shard->count;
+	if ((index >> INTERN_PAGE_BITS) >= INTERN_MAX_PAGES)
+	{
+		puts("Symbol table is full");
+		abort();
+	}
+
+	if (!shard->strings)
+		shard->strings = arena_create();
+	if (!shard->pages[index >> INTERN_PAGE_BITS])
+		shard->pages[index >> INTERN_PAGE_BITS] = (InternEntry*)malloc(sizeof(InternEntry) * INTERN_PAGE_SIZE);
+
+	*shard_entry(shard, index) = {
+		.name = arena_strdup(shard->strings, str, length),
+		.length = (uint32_t)length,
+		.hash = hash
+	};
+	shard->table[slot] = index + 1;
+	shard->count++;
+	return make_symbol(shard_index, index);
+}
+
+Symbol intern(const char* str)
+{
+	return intern(str, strlen(str));
+}
+
+const char* symbol_name(Symbol symbol)
+{
+	if (symbol == SYMBOL_NONE)
+		return nullptr;
+	return symbol_entry(symbol)->name;
+}
+
+size_t symbol_length(Symbol symbol)
+{
+	if (symbol == SYMBOL_NONE)
+		return 0;
+	return symbol_entry(symbol)->length;
+}
+
+size_t symbol_count()
+{
+	size_t count = 0;
+	for (int i = 0; i < INTERN_SHARD_COUNT; i++)
+	{
+		std::lock_guard<std::mutex> lock(shards[i].mutex);
+		count += shards[i].count;
+	}
+	return count;
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+//Interned identifier. Two symbols are equal exactly when their spellings are equal
+typedef uint32_t Symbol;
+
+#define SYMBOL_NONE 0
+
+extern Symbol intern(const char* str, size_t length);
+extern Symbol intern(const char* str);
+extern const char* symbol_name(Symbol symbol);
+extern size_t symbol_length(Symbol symbol);
+extern size_t symbol_count();
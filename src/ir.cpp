@@ -0,0 +1,844 @@
+#include "ir.h"
+#include <unordered_map>
+#include <unordered_set>
+
+enum class LowerMode : uint8_t
+{
+	//Push the value of the node
+	VALUE,
+	//Push the address the node refers to
+	ADDRESS,
+	//Lower the node as a statement and push nothing
+	EFFECT,
+};
+
+enum class LowerStep : uint8_t
+{
+	NODE,
+	//Drop the value on top of the value stack
+	DISCARD,
+	CLOSE_SCOPE,
+};
+
+struct LowerFrame
+{
+	LowerStep step;
+	LowerMode mode;
+	uint8_t state;
+	const Node* node;
+	uint32_t data;
+};
+
+enum class BindingKind : uint8_t
+{
+	REGISTER,
+	SLOT,
+};
+
+struct Binding
+{
+	BindingKind kind;
+	uint32_t index;
+};
+
+//Undo record for a name bound in the current scope
+struct ScopeChange
+{
+	Symbol name;
+	bool shadowed;
+	Binding previous;
+};
+
+//Lowering walks the tree with an explicit stack of frames, like the dumper, so deep expressions cannot overflow
+//the call stack. Nodes which need their operands first push themselves back with the next state
+struct Lowerer
+{
+	IrFunction* ir;
+	std::vector<LowerFrame> frames;
+	std::vector<IrRegister> values;
+	//Names which appear under a REFERENCE anywhere in the function. Locals by those names live in stack slots
+	std::unordered_set<Symbol> address_taken;
+	std::unordered_map<Symbol, Binding> bindings;
+	std::vector<ScopeChange> changes;
+	std::vector<size_t> scopes;
+	std::vector<const Node*> arguments;
+	bool failed = false;
+};
+
+static void lower_error(Lowerer* lowerer, const char* message)
+{
+	printf("%s: %s\n", symbol_name(lowerer->ir->name), message);
+	lowerer->failed = true;
+}
+
+static uint32_t emit(Lowerer* lowerer, const IrInstruction& instruction)
+{
+	lowerer->ir->instructions.push_back(instruction);
+	return (uint32_t)lowerer->ir->instructions.size() - 1;
+}
+
+static IrRegister emit_value(Lowerer* lowerer, IrOp op, uint32_t a, uint32_t b)
+{
+	IrRegister dst = lowerer->ir->register_count++;
+	emit(lowerer, { .op = op, .dst = dst, .a = a, .b = b });
+	return dst;
+}
+
+static IrRegister emit_const(Lowerer* lowerer, int16_t value)
+{
+	IrRegister dst = lowerer->ir->register_count++;
+	emit(lowerer, { .op = IrOp::CONST, .value = value, .dst = dst });
+	return dst;
+}
+
+//Starts a new block at the next instruction and returns its index. An empty block at the end is reused
+static uint32_t start_block(Lowerer* lowerer)
+{
+	std::vector<IrBlock>& blocks = lowerer->ir->blocks;
+	uint32_t first = (uint32_t)lowerer->ir->instructions.size();
+	if (blocks.empty() || blocks.back().first != first)
+		blocks.push_back({ .first = first });
+	return (uint32_t)blocks.size() - 1;
+}
+
+static void push_node(Lowerer* lowerer, const Node* node, LowerMode mode)
+{
+	lowerer->frames.push_back({ .step = LowerStep::NODE, .mode = mode, .node = node });
+}
+
+static void push_step(Lowerer* lowerer, LowerStep step)
+{
+	lowerer->frames.push_back({ .step = step });
+}
+
+//Pushes the frame back so it runs again in its next state once the frames pushed after it are done
+static void resume(Lowerer* lowerer, LowerFrame frame, uint32_t data)
+{
+	frame.state++;
+	frame.data = data;
+	lowerer->frames.push_back(frame);
+}
+
+static IrRegister pop_value(Lowerer* lowerer)
+{
+	IrRegister value = lowerer->values.back();
+	lowerer->values.pop_back();
+	return value;
+}
+
+static void open_scope(Lowerer* lowerer)
+{
+	lowerer->scopes.push_back(lowerer->changes.size());
+}
+
+static void close_scope(Lowerer* lowerer)
+{
+	size_t mark = lowerer->scopes.back();
+	lowerer->scopes.pop_back();
+	while (lowerer->changes.size() > mark)
+	{
+		ScopeChange& change = lowerer->changes.back();
+		if (change.shadowed)
+			lowerer->bindings[change.name] = change.previous;
+		else
+			lowerer->bindings.erase(change.name);
+		lowerer->changes.pop_back();
+	}
+}
+
+static void bind(Lowerer* lowerer, Symbol name, Binding binding)
+{
+	auto existing = lowerer->bindings.find(name);
+	if (existing != lowerer->bindings.end())
+	{
+		lowerer->changes.push_back({ .name = name, .shadowed = true, .previous = existing->second });
+		existing->second = binding;
+		return;
+	}
+	lowerer->changes.push_back({ .name = name });
+	lowerer->bindings[name] = binding;
+}
+
+static Binding declare(Lowerer* lowerer, Symbol name)
+{
+	Binding binding;
+	if (lowerer->address_taken.count(name))
+		binding = { .kind = BindingKind::SLOT, .index = lowerer->ir->slot_count++ };
+	else
+		binding = { .kind = BindingKind::REGISTER, .index = lowerer->ir->register_count++ };
+	bind(lowerer, name, binding);
+	return binding;
+}
+
+static IrRegister read_binding(Lowerer* lowerer, Binding binding)
+{
+	if (binding.kind == BindingKind::REGISTER)
+		return binding.index;
+	return emit_value(lowerer, IrOp::LOAD, emit_value(lowerer, IrOp::LOCAL, binding.index, 0), 0);
+}
+
+static void write_binding(Lowerer* lowerer, Binding binding, IrRegister value)
+{
+	if (binding.kind == BindingKind::REGISTER)
+		emit(lowerer, { .op = IrOp::MOV, .dst = binding.index, .a = value });
+	else
+		emit(lowerer, { .op = IrOp::STORE, .a = emit_value(lowerer, IrOp::LOCAL, binding.index, 0), .b = value });
+}
+
+//Names which are not locals or parameters refer to globals
+static IrRegister name_address(Lowerer* lowerer, Symbol name)
+{
+	auto binding = lowerer->bindings.find(name);
+	if (binding == lowerer->bindings.end())
+		return emit_value(lowerer, IrOp::GLOBAL, name, 0);
+	if (binding->second.kind == BindingKind::SLOT)
+		return emit_value(lowerer, IrOp::LOCAL, binding->second.index, 0);
+	//Locals whose address is taken are always given slots, so this only happens on a malformed tree
+	lower_error(lowerer, "Cannot take the address of a register local");
+	return 0;
+}
+
+static IrRegister read_name(Lowerer* lowerer, Symbol name)
+{
+	auto binding = lowerer->bindings.find(name);
+	if (binding == lowerer->bindings.end())
+		return emit_value(lowerer, IrOp::LOAD, emit_value(lowerer, IrOp::GLOBAL, name, 0), 0);
+	return read_binding(lowerer, binding->second);
+}
+
+//Declarations without a value start out zero
+static Binding declare_zeroed(Lowerer* lowerer, Symbol name)
+{
+	Binding binding = declare(lowerer, name);
+	write_binding(lowerer, binding, emit_const(lowerer, 0));
+	return binding;
+}
+
+static void find_address_taken(Lowerer* lowerer, const Node* body)
+{
+	std::vector<const Node*> stack;
+	if (body)
+		stack.push_back(body);
+	while (!stack.empty())
+	{
+		const Node* node = stack.back();
+		stack.pop_back();
+		if (node->type == NodeType::REFERENCE && node->right &&
+			(node->right->type == NodeType::IDENTIFIER || node->right->type == NodeType::VARDECL))
+			lowerer->address_taken.insert(node->right->value.name);
+		if (node->left)
+			stack.push_back(node->left);
+		if (node->right)
+			stack.push_back(node->right);
+	}
+}
+
+//IF becomes a BRANCH_ZERO over the then block, which jumps over the else block if there is one. Each arm is a
+//scope of its own
+static void lower_if(Lowerer* lowerer, LowerFrame frame)
+{
+	const Node* node = frame.node;
+	const Node* branch = node->right;
+	IrFunction* ir = lowerer->ir;
+	switch (frame.state)
+	{
+	case 0:
+		if (!node->left || !branch || branch->type != NodeType::IF_BRANCH)
+		{
+			lower_error(lowerer, "Malformed if statement");
+			return;
+		}
+		resume(lowerer, frame, 0);
+		push_node(lowerer, node->left, LowerMode::VALUE);
+		return;
+	case 1:
+	{
+		uint32_t branch_zero = emit(lowerer, { .op = IrOp::BRANCH_ZERO, .a = pop_value(lowerer) });
+		start_block(lowerer);
+		open_scope(lowerer);
+		resume(lowerer, frame, branch_zero);
+		push_step(lowerer, LowerStep::CLOSE_SCOPE);
+		push_node(lowerer, branch->left, LowerMode::EFFECT);
+		return;
+	}
+	case 2:
+		if (!branch->right)
+		{
+			ir->instructions[frame.data].b = start_block(lowerer);
+			return;
+		}
+		{
+			uint32_t jump = emit(lowerer, { .op = IrOp::JUMP });
+			ir->instructions[frame.data].b = start_block(lowerer);
+			open_scope(lowerer);
+			resume(lowerer, frame, jump);
+			push_step(lowerer, LowerStep::CLOSE_SCOPE);
+			push_node(lowerer, branch->right, LowerMode::EFFECT);
+		}
+		return;
+	default:
+		ir->instructions[frame.data].a = start_block(lowerer);
+		return;
+	}
+}
+
+//Named targets are written once the value is known, so a declaration only comes into scope after its own value.
+//Dereferenced targets evaluate the address before the value
+static void lower_assign(Lowerer* lowerer, LowerFrame frame)
+{
+	const Node* node = frame.node;
+	const Node* target = node->left;
+	switch (frame.state)
+	{
+	case 0:
+		if (!target || !node->right)
+		{
+			lower_error(lowerer, "Malformed assignment");
+			return;
+		}
+		if (target->type == NodeType::IDENTIFIER || target->type == NodeType::VARDECL)
+		{
+			resume(lowerer, frame, 0);
+			push_node(lowerer, node->right, LowerMode::VALUE);
+		}
+		else if (target->type == NodeType::DEREFERECE && target->right)
+		{
+			//Skips the named target state
+			frame.state = 2;
+			lowerer->frames.push_back(frame);
+			push_node(lowerer, node->right, LowerMode::VALUE);
+			push_node(lowerer, target->right, LowerMode::VALUE);
+		}
+		else
+		{
+			lower_error(lowerer, "Cannot assign to this expression");
+		}
+		return;
+	case 1:
+	{
+		IrRegister value = pop_value(lowerer);
+		Symbol name = target->value.name;
+		auto binding = lowerer->bindings.find(name);
+		if (target->type == NodeType::VARDECL)
+			write_binding(lowerer, declare(lowerer, name), value);
+		else if (binding != lowerer->bindings.end())
+			write_binding(lowerer, binding->second, value);
+		else
+			emit(lowerer, { .op = IrOp::STORE, .a = emit_value(lowerer, IrOp::GLOBAL, name, 0), .b = value });
+		lowerer->values.push_back(value);
+		return;
+	}
+	default:
+	{
+		IrRegister value = pop_value(lowerer);
+		IrRegister address = pop_value(lowerer);
+		emit(lowerer, { .op = IrOp::STORE, .a = address, .b = value });
+		lowerer->values.push_back(value);
+		return;
+	}
+	}
+}
+
+//The arguments are the operands of the comma list in the call's parentheses. A parenthesised comma inside it is a
+//single argument
+static void lower_call(Lowerer* lowerer, LowerFrame frame)
+{
+	const Node* node = frame.node;
+	IrFunction* ir = lowerer->ir;
+	if (frame.state == 0)
+	{
+		std::vector<const Node*>& arguments = lowerer->arguments;
+		arguments.clear();
+		std::vector<const Node*> stack;
+		if (node->right)
+			stack.push_back(node->right);
+		while (!stack.empty())
+		{
+			const Node* argument = stack.back();
+			stack.pop_back();
+			if (argument->type == NodeType::COMMA && (argument == node->right || !argument->paren) && argument->left && argument->right)
+			{
+				stack.push_back(argument->right);
+				stack.push_back(argument->left);
+			}
+			else
+			{
+				arguments.push_back(argument);
+			}
+		}
+
+		resume(lowerer, frame, (uint32_t)arguments.size());
+		for (size_t i = arguments.size(); i-- > 0;)
+			push_node(lowerer, arguments[i], LowerMode::VALUE);
+		return;
+	}
+
+	uint32_t count = frame.data;
+	IrCall call = {
+		.name = node->value.name,
+		.first_argument = (uint32_t)ir->arguments.size(),
+		.argument_count = count
+	};
+	ir->arguments.insert(ir->arguments.end(), lowerer->values.end() - count, lowerer->values.end());
+	lowerer->values.resize(lowerer->values.size() - count);
+	ir->calls.push_back(call);
+	lowerer->values.push_back(emit_value(lowerer, IrOp::CALL, (uint32_t)ir->calls.size() - 1, 0));
+}
+
+static void lower_value(Lowerer* lowerer, LowerFrame frame)
+{
+	const Node* node = frame.node;
+	switch (node->type)
+	{
+	case NodeType::INT_LITERAL:
+		lowerer->values.push_back(emit_const(lowerer, (int16_t)(uint16_t)node->value.parsed_int));
+		return;
+	case NodeType::IDENTIFIER:
+		lowerer->values.push_back(read_name(lowerer, node->value.name));
+		return;
+	case NodeType::VARDECL:
+		lowerer->values.push_back(read_binding(lowerer, declare_zeroed(lowerer, node->value.name)));
+		return;
+	case NodeType::REFERENCE:
+		if (!node->right)
+			break;
+		push_node(lowerer, node->right, LowerMode::ADDRESS);
+		return;
+	case NodeType::DEREFERECE:
+		if (!node->right)
+			break;
+		if (frame.state == 0)
+		{
+			resume(lowerer, frame, 0);
+			push_node(lowerer, node->right, LowerMode::VALUE);
+			return;
+		}
+		lowerer->values.push_back(emit_value(lowerer, IrOp::LOAD, pop_value(lowerer), 0));
+		return;
+	case NodeType::ADD:
+	case NodeType::SUBTRACT:
+	case NodeType::MULTIPLY:
+		if (!node->left || !node->right)
+			break;
+		if (frame.state == 0)
+		{
+			resume(lowerer, frame, 0);
+			push_node(lowerer, node->right, LowerMode::VALUE);
+			push_node(lowerer, node->left, LowerMode::VALUE);
+			return;
+		}
+		{
+			IrRegister b = pop_value(lowerer);
+			IrRegister a = pop_value(lowerer);
+			IrOp op = node->type == NodeType::ADD ? IrOp::ADD : node->type == NodeType::SUBTRACT ? IrOp::SUB : IrOp::MUL;
+			lowerer->values.push_back(emit_value(lowerer, op, a, b));
+		}
+		return;
+	case NodeType::ASSIGN:
+		lower_assign(lowerer, frame);
+		return;
+	case NodeType::COMMA:
+		if (!node->left || !node->right)
+			break;
+		push_node(lowerer, node->right, LowerMode::VALUE);
+		push_step(lowerer, LowerStep::DISCARD);
+		push_node(lowerer, node->left, LowerMode::VALUE);
+		return;
+	case NodeType::CALL:
+		lower_call(lowerer, frame);
+		return;
+	default:
+		lower_error(lowerer, "Statement used as a value");
+		return;
+	}
+	lower_error(lowerer, "Operator is missing an operand");
+}
+
+//Variables and dereferences have addresses of their own. The address of any other value is the address of a
+//fresh stack slot holding it, like a compound literal in C
+static void lower_address(Lowerer* lowerer, LowerFrame frame)
+{
+	const Node* node = frame.node;
+	IrFunction* ir = lowerer->ir;
+	switch (node->type)
+	{
+	case NodeType::IDENTIFIER:
+		lowerer->values.push_back(name_address(lowerer, node->value.name));
+		return;
+	case NodeType::VARDECL:
+		declare_zeroed(lowerer, node->value.name);
+		lowerer->values.push_back(name_address(lowerer, node->value.name));
+		return;
+	case NodeType::DEREFERECE:
+		if (!node->right)
+		{
+			lower_error(lowerer, "Operator is missing an operand");
+			return;
+		}
+		push_node(lowerer, node->right, LowerMode::VALUE);
+		return;
+	}
+
+	if (frame.state == 0)
+	{
+		resume(lowerer, frame, 0);
+		push_node(lowerer, node, LowerMode::VALUE);
+		return;
+	}
+	IrRegister value = pop_value(lowerer);
+	IrRegister address = emit_value(lowerer, IrOp::LOCAL, ir->slot_count++, 0);
+	emit(lowerer, { .op = IrOp::STORE, .a = address, .b = value });
+	lowerer->values.push_back(address);
+}
+
+static void lower_node(Lowerer* lowerer, LowerFrame frame)
+{
+	const Node* node = frame.node;
+	if (frame.mode == LowerMode::ADDRESS)
+	{
+		lower_address(lowerer, frame);
+		return;
+	}
+	if (frame.mode == LowerMode::VALUE)
+	{
+		lower_value(lowerer, frame);
+		return;
+	}
+
+	//Statements
+	if (!node)
+		return;
+	switch (node->type)
+	{
+	case NodeType::EXP_SEQUENCE:
+		push_node(lowerer, node->right, LowerMode::EFFECT);
+		push_node(lowerer, node->left, LowerMode::EFFECT);
+		return;
+	case NodeType::IF:
+		lower_if(lowerer, frame);
+		return;
+	default:
+		push_step(lowerer, LowerStep::DISCARD);
+		push_node(lowerer, node, LowerMode::VALUE);
+		return;
+	}
+}
+
+//Lowers a function body to IR. Returns false after reporting the error if the tree has a construct with no
+//meaning, such as assigning to the result of an addition
+bool ir_lower_function(const FunctionDescriptor* function, const Node* body, IrFunction* ir)
+{
+	*ir = {};
+	ir->name = function->name;
+	Lowerer lowerer = { .ir = ir };
+	find_address_taken(&lowerer, body);
+	start_block(&lowerer);
+	open_scope(&lowerer);
+
+	//The parameters arrive in the first registers. Those whose address is taken are copied to slots on entry
+	std::vector<Symbol> parameters;
+	if (function->has_this)
+		parameters.push_back(intern("this"));
+	for (const FunctionParameter& parameter : function->parameters)
+		parameters.push_back(parameter.name);
+	ir->parameter_count = (uint32_t)parameters.size();
+	ir->register_count = ir->parameter_count;
+	for (uint32_t i = 0; i < ir->parameter_count; i++)
+	{
+		if (!lowerer.address_taken.count(parameters[i]))
+		{
+			bind(&lowerer, parameters[i], { .kind = BindingKind::REGISTER, .index = i });
+			continue;
+		}
+		Binding binding = { .kind = BindingKind::SLOT, .index = ir->slot_count++ };
+		write_binding(&lowerer, binding, i);
+		bind(&lowerer, parameters[i], binding);
+	}
+
+	push_node(&lowerer, body, LowerMode::EFFECT);
+	while (!lowerer.frames.empty() && !lowerer.failed)
+	{
+		LowerFrame frame = lowerer.frames.back();
+		lowerer.frames.pop_back();
+		switch (frame.step)
+		{
+		case LowerStep::NODE:
+			lower_node(&lowerer, frame);
+			break;
+		case LowerStep::DISCARD:
+			lowerer.values.pop_back();
+			break;
+		case LowerStep::CLOSE_SCOPE:
+			close_scope(&lowerer);
+			break;
+		}
+	}
+	if (lowerer.failed)
+		return false;
+
+	emit(&lowerer, { .op = IrOp::RET });
+	for (size_t i = 0; i < ir->blocks.size(); i++)
+	{
+		uint32_t end = i + 1 < ir->blocks.size() ? ir->blocks[i + 1].first : (uint32_t)ir->instructions.size();
+		ir->blocks[i].count = end - ir->blocks[i].first;
+	}
+	return true;
+}
+
+bool ir_defines(IrOp op)
+{
+	switch (op)
+	{
+	case IrOp::STORE:
+	case IrOp::JUMP:
+	case IrOp::BRANCH_ZERO:
+	case IrOp::RET:
+		return false;
+	}
+	return true;
+}
+
+//Fills uses with the registers the instruction reads and returns how many there are. The arguments of a CALL are
+//not included, they are in the function's argument list
+int ir_uses(const IrInstruction& instruction, IrRegister uses[2])
+{
+	switch (instruction.op)
+	{
+	case IrOp::MOV:
+	case IrOp::SHL:
+	case IrOp::LOAD:
+	case IrOp::BRANCH_ZERO:
+		uses[0] = instruction.a;
+		return 1;
+	case IrOp::ADD:
+	case IrOp::SUB:
+	case IrOp::MUL:
+	case IrOp::STORE:
+		uses[0] = instruction.a;
+		uses[1] = instruction.b;
+		return 2;
+	}
+	return 0;
+}
+
+//Cycles the target takes for the instruction. The multiplier retires a bit of the multiplier per cycle and the
+//shifter moves a single bit position per cycle. Memory, branches and calls take an extra cycle or more
+int ir_cycles(const IrInstruction& instruction)
+{
+	switch (instruction.op)
+	{
+	case IrOp::MUL:
+		return 17;
+	case IrOp::SHL:
+		return instruction.value > 1 ? instruction.value : 1;
+	case IrOp::LOAD:
+	case IrOp::STORE:
+	case IrOp::JUMP:
+	case IrOp::BRANCH_ZERO:
+	case IrOp::RET:
+		return 2;
+	case IrOp::CALL:
+		return 4;
+	}
+	return 1;
+}
+
+//Sum of the cycles of every instruction, each counted once
+uint64_t ir_function_cycles(const IrFunction* ir)
+{
+	uint64_t cycles = 0;
+	for (const IrInstruction& instruction : ir->instructions)
+		cycles += ir_cycles(instruction);
+	return cycles;
+}
+
+static bool is_terminator(IrOp op)
+{
+	return op == IrOp::JUMP || op == IrOp::BRANCH_ZERO || op == IrOp::RET;
+}
+
+static bool verify_error(const IrFunction* ir, uint32_t index, const char* message)
+{
+	printf("%s: instruction %u: %s\n", symbol_name(ir->name), index, message);
+	return false;
+}
+
+//Checks the structure of the function: blocks tile the instructions in order, control only leaves a block at its
+//end, every operand is in range and every register is defined somewhere or is a parameter
+bool ir_verify(const IrFunction* ir)
+{
+	uint32_t count = (uint32_t)ir->instructions.size();
+	if (ir->blocks.empty() || ir->blocks[0].first != 0)
+		return verify_error(ir, 0, "blocks do not start at the first instruction");
+
+	uint32_t block_count = (uint32_t)ir->blocks.size();
+	for (uint32_t i = 0; i < block_count; i++)
+	{
+		const IrBlock& block = ir->blocks[i];
+		uint32_t end = i + 1 < block_count ? ir->blocks[i + 1].first : count;
+		if (block.first + block.count != end || block.count == 0)
+			return verify_error(ir, block.first, "blocks are empty or do not tile the instructions");
+		for (uint32_t j = block.first; j + 1 < end; j++)
+			if (is_terminator(ir->instructions[j].op))
+				return verify_error(ir, j, "terminator in the middle of a block");
+		IrOp last = ir->instructions[end - 1].op;
+		if (i + 1 == block_count && last != IrOp::JUMP && last != IrOp::RET)
+			return verify_error(ir, end - 1, "last block falls off the end of the function");
+	}
+
+	std::vector<bool> defined(ir->register_count, false);
+	for (uint32_t i = 0; i < ir->parameter_count && i < ir->register_count; i++)
+		defined[i] = true;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const IrInstruction& instruction = ir->instructions[i];
+		if (ir_defines(instruction.op))
+		{
+			if (instruction.dst >= ir->register_count)
+				return verify_error(ir, i, "destination register out of range");
+			defined[instruction.dst] = true;
+		}
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const IrInstruction& instruction = ir->instructions[i];
+		IrRegister uses[2];
+		int use_count = ir_uses(instruction, uses);
+		for (int u = 0; u < use_count; u++)
+			if (uses[u] >= ir->register_count || !defined[uses[u]])
+				return verify_error(ir, i, "operand register is never defined");
+
+		switch (instruction.op)
+		{
+		case IrOp::SHL:
+			if (instruction.value < 1 || instruction.value > 15)
+				return verify_error(ir, i, "shift amount out of range");
+			break;
+		case IrOp::LOCAL:
+			if (instruction.a >= ir->slot_count)
+				return verify_error(ir, i, "stack slot out of range");
+			break;
+		case IrOp::CALL:
+		{
+			if (instruction.a >= ir->calls.size())
+				return verify_error(ir, i, "call out of range");
+			const IrCall& call = ir->calls[instruction.a];
+			if ((size_t)call.first_argument + call.argument_count > ir->arguments.size())
+				return verify_error(ir, i, "call arguments out of range");
+			for (uint32_t a = 0; a < call.argument_count; a++)
+			{
+				IrRegister argument = ir->arguments[call.first_argument + a];
+				if (argument >= ir->register_count || !defined[argument])
+					return verify_error(ir, i, "argument register is never defined");
+			}
+			break;
+		}
+		case IrOp::JUMP:
+			if (instruction.a >= block_count)
+				return verify_error(ir, i, "jump target out of range");
+			break;
+		case IrOp::BRANCH_ZERO:
+			if (instruction.b >= block_count)
+				return verify_error(ir, i, "branch target out of range");
+			break;
+		}
+	}
+	return true;
+}
+
+static const char* op_name(IrOp op)
+{
+	switch (op)
+	{
+	case IrOp::CONST:
+		return "const";
+	case IrOp::MOV:
+		return "mov";
+	case IrOp::ADD:
+		return "add";
+	case IrOp::SUB:
+		return "sub";
+	case IrOp::MUL:
+		return "mul";
+	case IrOp::SHL:
+		return "shl";
+	case IrOp::LOAD:
+		return "load";
+	case IrOp::STORE:
+		return "store";
+	case IrOp::LOCAL:
+		return "local";
+	case IrOp::GLOBAL:
+		return "global";
+	case IrOp::CALL:
+		return "call";
+	case IrOp::JUMP:
+		return "jump";
+	case IrOp::BRANCH_ZERO:
+		return "branch_zero";
+	case IrOp::RET:
+		return "ret";
+	}
+	return "invalid";
+}
+
+void ir_print(FILE* file, const IrFunction* ir)
+{
+	fprintf(file, "fn %s (%u parameters, %u registers, %u slots)\n", symbol_name(ir->name), ir->parameter_count,
+		ir->register_count, ir->slot_count);
+	for (size_t b = 0; b < ir->blocks.size(); b++)
+	{
+		fprintf(file, "b%zu:\n", b);
+		for (uint32_t i = ir->blocks[b].first; i < ir->blocks[b].first + ir->blocks[b].count; i++)
+		{
+			const IrInstruction& instruction = ir->instructions[i];
+			fputc('\t', file);
+			if (ir_defines(instruction.op))
+				fprintf(file, "r%u = ", instruction.dst);
+			fputs(op_name(instruction.op), file);
+
+			switch (instruction.op)
+			{
+			case IrOp::CONST:
+				fprintf(file, " %d", instruction.value);
+				break;
+			case IrOp::MOV:
+			case IrOp::LOAD:
+				fprintf(file, " r%u", instruction.a);
+				break;
+			case IrOp::SHL:
+				fprintf(file, " r%u, %d", instruction.a, instruction.value);
+				break;
+			case IrOp::ADD:
+			case IrOp::SUB:
+			case IrOp::MUL:
+			case IrOp::STORE:
+				fprintf(file, " r%u, r%u", instruction.a, instruction.b);
+				break;
+			case IrOp::LOCAL:
+				fprintf(file, " s%u", instruction.a);
+				break;
+			case IrOp::GLOBAL:
+				fprintf(file, " %s", symbol_name(instruction.a));
+				break;
+			case IrOp::CALL:
+			{
+				const IrCall& call = ir->calls[instruction.a];
+				fprintf(file, " %s(", symbol_name(call.name));
+				for (uint32_t a = 0; a < call.argument_count; a++)
+					fprintf(file, a ? ", r%u" : "r%u", ir->arguments[call.first_argument + a]);
+				fputc(')', file);
+				break;
+			}
+			case IrOp::JUMP:
+				fprintf(file, " b%u", instruction.a);
+				break;
+			case IrOp::BRANCH_ZERO:
+				fprintf(file, " r%u, b%u", instruction.a, instruction.b);
+				break;
+			}
+			fputc('\n', file);
+		}
+	}
+}
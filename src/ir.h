@@ -0,0 +1,86 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "ast.h"
+
+//Virtual register. Registers are numbered per function and the parameters take the first ones, which hold the
+//arguments on entry. Temporaries are assigned once, locals are assigned by every ASSIGN to them
+typedef uint32_t IrRegister;
+
+enum class IrOp : uint8_t
+{
+	//dst = value
+	CONST,
+	//dst = a
+	MOV,
+	//dst = a op b, wrapping at 16 bits
+	ADD,
+	SUB,
+	MUL,
+	//dst = a shifted left by value bits
+	SHL,
+	//dst = word at address a
+	LOAD,
+	//Word at address a = b
+	STORE,
+	//dst = address of stack slot a
+	LOCAL,
+	//dst = address of the global whose name is symbol a
+	GLOBAL,
+	//dst = result of calls[a]
+	CALL,
+	//Go to block a
+	JUMP,
+	//Go to block b if a is zero, otherwise continue with the next block
+	BRANCH_ZERO,
+	//Return from the function
+	RET,
+};
+
+//Which fields are used depends on the op, ir_defines and ir_uses tell the register fields apart
+struct IrInstruction
+{
+	IrOp op;
+	int16_t value;
+	IrRegister dst;
+	uint32_t a;
+	uint32_t b;
+};
+
+struct IrCall
+{
+	Symbol name;
+	//Range of the argument registers in IrFunction::arguments
+	uint32_t first_argument;
+	uint32_t argument_count;
+};
+
+//Blocks are stored in layout order and their instructions are contiguous, each block starting where the one
+//before it ends. A block which does not end in JUMP or RET continues with the next one
+struct IrBlock
+{
+	uint32_t first;
+	uint32_t count;
+};
+
+struct IrFunction
+{
+	Symbol name = SYMBOL_NONE;
+	std::vector<IrInstruction> instructions;
+	std::vector<IrBlock> blocks;
+	std::vector<IrCall> calls;
+	std::vector<IrRegister> arguments;
+	uint32_t register_count = 0;
+	uint32_t parameter_count = 0;
+	//Word sized stack slots, for locals whose address is taken and values whose address is taken
+	uint32_t slot_count = 0;
+};
+
+extern bool ir_lower_function(const FunctionDescriptor* function, const Node* body, IrFunction* ir);
+extern bool ir_verify(const IrFunction* ir);
+extern void ir_print(FILE* file, const IrFunction* ir);
+extern bool ir_defines(IrOp op);
+extern int ir_uses(const IrInstruction& instruction, IrRegister uses[2]);
+extern int ir_cycles(const IrInstruction& instruction);
+extern uint64_t ir_function_cycles(const IrFunction* ir);
@@ -1,14 +1,375 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "tokenize.h"
 #include "ast.h"
 #include "parser.h"
+#include "bench.h"
+#include "dump.h"
+#include "ast_file.h"
+#include "ir.h"
+#include "constant_fold.h"
+#include "dead_code.h"
+#include "strength_reduce.h"
+#include "register_allocator.h"
+#include <vector>
+#include <chrono>
+
+//Reads a manifest listing one input file per line. Blank lines are skipped
+static bool read_manifest(const char* filepath, std::vector<const char*>& filepaths)
+{
+	SourceBuffer manifest;
+	if (!source_buffer_open(&manifest, filepath))
+		return false;
+
+	const char* end = manifest.data + manifest.length;
+	const char* line = manifest.data;
+	while (line < end)
+	{
+		const char* line_end = (const char*)memchr(line, '\n', end - line);
+		if (!line_end)
+			line_end = end;
+		size_t length = line_end - line;
+		if (length && line[length - 1] == '\r')
+			length--;
+		if (length)
+		{
+			char* path = (char*)malloc(length + 1);
+			memcpy(path, line, length);
+			path[length] = 0;
+			filepaths.push_back(path);
+		}
+		line = line_end + 1;
+	}
+
+	source_buffer_close(&manifest);
+	return true;
+}
+
+//Dumps every function of every parsed file. Linearized files no longer have pointer trees, so only their
+//signatures are written
+static bool dump_functions(ParserContext* ctx, const char* filepath, DumpFormat format)
+{
+	DumpWriter writer;
+	if (!dump_open(&writer, filepath, format))
+		return false;
+
+	bool result = true;
+	for (SourceFile* source_file : ctx->source_files)
+	{
+		for (FunctionDescriptor& function : source_file->functions.functions)
+		{
+			Node* node = nullptr;
+			if (!source_file->linearized && !function_node(source_file, &function, &node))
+				result = false;
+			dump_function(&writer, &function, node);
+		}
+	}
+
+	return dump_close(&writer) && result;
+}
+
+//Loads the functions of an AST file back into trees and dumps them as text to dump_path, or stdout if it is null
+static bool read_ast(const char* filepath, const char* dump_path)
+{
+	AstFile file;
+	if (!ast_file_open(&file, filepath))
+		return false;
+
+	DumpWriter writer;
+	if (!dump_open(&writer, dump_path, DumpFormat::TEXT))
+	{
+		ast_file_close(&file);
+		return false;
+	}
+
+	NodeAllocator* allocator = node_allocator_create();
+	bool result = true;
+	for (uint32_t i = 0; result && i < file.header->function_count; i++)
+	{
+		FunctionDescriptor function;
+		result = ast_file_load_function(&file, i, allocator, &function);
+		if (result)
+			dump_function(&writer, &function, function.node);
+	}
+
+	node_allocator_free(allocator);
+	ast_file_close(&file);
+	return dump_close(&writer) && result;
+}
+
+//Runs pass over the tree of every function of every parsed file and returns the number of nodes it removed
+static size_t run_tree_pass(ParserContext* ctx, size_t (*pass)(Node** tree), bool* result)
+{
+	size_t removed = 0;
+	for (SourceFile* source_file : ctx->source_files)
+	{
+		if (source_file->linearized)
+			continue;
+		for (FunctionDescriptor& function : source_file->functions.functions)
+		{
+			Node* node;
+			if (function_node(source_file, &function, &node))
+				removed += pass(&function.node);
+			else
+				*result = false;
+		}
+	}
+	return removed;
+}
+
+//Lowers every function of every parsed file to IR and prints it to filepath, or stdout if it is null or "-".
+//Multiplies by constants are strength reduced first if reduce is set. If machine_registers is not zero, each function
+//is followed by its register allocation
+static bool emit_ir(ParserContext* ctx, const char* filepath, bool reduce, uint32_t machine_registers)
+{
+	FILE* file = stdout;
+	if (filepath && strcmp(filepath, "-"))
+	{
+		file = fopen(filepath, "w");
+		if (!file)
+		{
+			printf("Failed to open file %s\n", filepath);
+			return false;
+		}
+	}
+
+	bool result = true;
+	IrFunction ir;
+	IrAllocation allocation;
+	for (SourceFile* source_file : ctx->source_files)
+	{
+		if (source_file->linearized)
+		{
+			printf("%s has been linearized and no longer has trees to lower\n", source_file->filepath);
+			result = false;
+			continue;
+		}
+		for (FunctionDescriptor& function : source_file->functions.functions)
+		{
+			Node* node;
+			if (!function_node(source_file, &function, &node) || !ir_lower_function(&function, node, &ir) || !ir_verify(&ir))
+			{
+				result = false;
+				continue;
+			}
+			if (reduce)
+				reduce_multiplies(&ir);
+			ir_print(file, &ir);
+			if (!machine_registers)
+				continue;
+			if (allocate_registers(&ir, machine_registers, &allocation))
+				print_allocation(file, &ir, &allocation);
+			else
+				result = false;
+		}
+	}
+
+	if (file != stdout && fclose(file))
+		result = false;
+	return result;
+}
+
+static void count_function(FunctionDescriptor* function, void* user)
+{
+	(*(int*)user)++;
+}
 
 int main(int argc, const char* argv[])
 {
+	if (argc == 3 && !strcmp(argv[1], "--bench-lexer"))
+		return bench_lexer(argv[2]) ? 0 : -1;
+
+	if (argc >= 3 && !strcmp(argv[1], "--bench-lexer-threads"))
+		return bench_lexer_threads(argv[2], argc >= 4 ? atoi(argv[3]) : 0) ? 0 : -1;
+
+	if (argc >= 2 && !strcmp(argv[1], "--bench-expressions"))
+		return bench_expressions(argc >= 3 ? atoi(argv[2]) : 0) ? 0 : -1;
+
+	if (argc == 3 && !strcmp(argv[1], "--stream"))
+	{
+		ParserContext ctx;
+		init_context(&ctx);
+		int function_count = 0;
+		if (!parse_file_streamed(&ctx, argv[2], count_function, &function_count))
+			return -1;
+		printf("Parsed %i functions\n", function_count);
+		return 0;
+	}
+
+	if (argc == 3 && !strcmp(argv[1], "--bench-ast-memory"))
+		return bench_ast_memory(argv[2]) ? 0 : -1;
+
+	if (argc == 3 && !strcmp(argv[1], "--bench-ast-walk"))
+		return bench_ast_walk(argv[2]) ? 0 : -1;
+
+	if (argc == 3 && !strcmp(argv[1], "--bench-indexing"))
+		return bench_indexing(argv[2]) ? 0 : -1;
+
+	if (argc >= 3 && !strcmp(argv[1], "--read-ast"))
+		return read_ast(argv[2], argc >= 4 ? argv[3] : nullptr) ? 0 : -1;
+
+	if (argc == 3 && !strcmp(argv[1], "--bench-ir"))
+		return bench_ir(argv[2]) ? 0 : -1;
+
+	if (argc == 3 && !strcmp(argv[1], "--bench-strength-reduction"))
+		return bench_strength_reduction(argv[2]) ? 0 : -1;
+
+	if (argc >= 3 && !strcmp(argv[1], "--bench-register-allocation"))
+		return bench_register_allocation(argv[2], argc >= 4 ? atoi(argv[3]) : 8) ? 0 : -1;
+
+	if (argc >= 3 && !strcmp(argv[1], "--bench-parser-threads"))
+		return bench_parser_threads(argv[2], argc >= 4 ? atoi(argv[3]) : 0) ? 0 : -1;
+
 	ParserContext ctx;
 	init_context(&ctx);
-	if (!parse_file(&ctx, "/code/sample.txt"))
+	ParseCache cache;
+	std::vector<const char*> filepaths;
+	const char* dump_path = nullptr;
+	const char* write_ast_path = nullptr;
+	const char* ir_path = nullptr;
+	bool fold = false;
+	bool eliminate = false;
+	bool reduce = false;
+	uint32_t machine_registers = 0;
+	const char* module_name = nullptr;
+	const char* interface_path = nullptr;
+	std::vector<const char*> imports;
+	DumpFormat dump_format = DumpFormat::TEXT;
+	for (int i = 1; i < argc; i++)
 	{
+		if (!strcmp(argv[i], "--lexer-threads") && i + 1 < argc)
+			ctx.lexer_threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--parser-threads") && i + 1 < argc)
+			ctx.parser_threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--lazy-bodies"))
+			ctx.lazy_bodies = true;
+		else if (!strcmp(argv[i], "--linearize"))
+			ctx.linearize = true;
+		else if (!strcmp(argv[i], "--dump") && i + 1 < argc)
+			dump_path = argv[++i];
+		else if (!strcmp(argv[i], "--json"))
+			dump_format = DumpFormat::JSON;
+		else if (!strcmp(argv[i], "--write-ast") && i + 1 < argc)
+			write_ast_path = argv[++i];
+		else if (!strcmp(argv[i], "--fold"))
+			fold = true;
+		else if (!strcmp(argv[i], "--eliminate-dead-code"))
+			eliminate = true;
+		else if (!strcmp(argv[i], "--strength-reduce"))
+			reduce = true;
+		else if (!strcmp(argv[i], "--registers") && i + 1 < argc)
+			machine_registers = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--emit-ir") && i + 1 < argc)
+			ir_path = argv[++i];
+		else if (!strcmp(argv[i], "--cache-dir") && i + 1 < argc)
+		{
+			cache.directory = argv[++i];
+			ctx.cache = &cache;
+		}
+		else if (!strcmp(argv[i], "--module") && i + 1 < argc)
+			module_name = argv[++i];
+		else if (!strcmp(argv[i], "--write-interface") && i + 1 < argc)
+			interface_path = argv[++i];
+		else if (!strcmp(argv[i], "--import") && i + 1 < argc)
+			imports.push_back(argv[++i]);
+		else if (!strcmp(argv[i], "--cache-limit") && i + 1 < argc)
+			cache.size_limit = strtoull(argv[++i], nullptr, 10);
+		else if (argv[i][0] == '@')
+		{
+			if (!read_manifest(argv[i] + 1, filepaths))
+				return -1;
+		}
+		else
+			filepaths.push_back(argv[i]);
+	}
+
+	if (interface_path && !module_name)
+	{
+		puts("--write-interface needs --module");
 		return -1;
 	}
-}
\ No newline at end of file
+
+	//Imported modules come from their interface files, their sources are never parsed
+	size_t import_count = 0;
+	for (const char* import : imports)
+	{
+		ModuleDescriptor* module = module_interface_load(import);
+		if (!module)
+			return -1;
+		import_count += module->exports.functions.size();
+		context_add_module(&ctx, module);
+	}
+
+	//Without any inputs the sample file is parsed and its first function dumped
+	if (filepaths.empty())
+	{
+		bool result = parse_file(&ctx, "/code/sample.txt");
+		if (result && !ctx.source_files[0]->linearized && !ctx.source_files[0]->functions.functions.empty())
+		{
+			Node* node;
+			result = function_node(ctx.source_files[0], &ctx.source_files[0]->functions.functions[0], &node);
+			if (result)
+				print_tree(nullptr, node);
+		}
+		free_context(&ctx);
+		return result ? 0 : -1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	bool result = parse_files(&ctx, filepaths);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	size_t function_count = 0;
+	for (SourceFile* source_file : ctx.source_files)
+		function_count += source_file->functions.functions.size();
+	size_t folded = fold ? run_tree_pass(&ctx, fold_constants, &result) : 0;
+	size_t eliminated = eliminate ? run_tree_pass(&ctx, eliminate_dead_code, &result) : 0;
+	if (dump_path && !dump_functions(&ctx, dump_path, dump_format))
+		result = false;
+	if (ir_path && !emit_ir(&ctx, ir_path, reduce, machine_registers))
+		result = false;
+	if (module_name)
+	{
+		//Every file passed on the command line belongs to the module
+		ModuleDescriptor* module = new ModuleDescriptor
+		{
+			.name = module_name
+		};
+		bool exported = true;
+		for (SourceFile* source_file : ctx.source_files)
+			if (!module_add_exports(module, source_file))
+				exported = false;
+		context_add_module(&ctx, module);
+		if (!exported || (interface_path && !module_interface_write(module, interface_path)))
+			result = false;
+	}
+	if (write_ast_path)
+	{
+		if (ctx.source_files.size() != 1)
+		{
+			puts("--write-ast needs exactly one input file");
+			result = false;
+		}
+		else if (!ast_file_write(ctx.source_files[0], write_ast_path))
+		{
+			result = false;
+		}
+	}
+	//Keep stdout clean for the dump itself
+	if ((!dump_path || strcmp(dump_path, "-")) && (!ir_path || strcmp(ir_path, "-")))
+	{
+		printf("Parsed %zu of %zu files, %zu functions in %.2f ms\n", ctx.source_files.size(), filepaths.size(), function_count, seconds * 1e3);
+		if (fold)
+			printf("Constant folding removed %zu nodes\n", folded);
+		if (eliminate)
+			printf("Dead code elimination removed %zu nodes\n", eliminated);
+		if (!imports.empty())
+			printf("Imported %zu modules, %zu functions\n", imports.size(), import_count);
+		if (ctx.cache)
+			printf("Parse cache: %llu hits, %llu misses\n", (unsigned long long)cache.hits, (unsigned long long)cache.misses);
+	}
+
+	free_context(&ctx);
+	return result ? 0 : -1;
+}
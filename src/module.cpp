@@ -0,0 +1,78 @@
+#include "module.h"
+#include "parser.h"
+#include "ast_file.h"
+#include <stdio.h>
+
+//Exports the signatures of every function in the file. Fails if the module already exports one of the names
+bool module_add_exports(ModuleDescriptor* module, SourceFile* source_file)
+{
+	for (const FunctionDescriptor& function : source_file->functions.functions)
+	{
+		FunctionDescriptor signature = {
+			.name = function.name,
+			.parameters = function.parameters,
+			.return_type = function.return_type,
+			.this_type_descriptor = function.this_type_descriptor,
+			.node = nullptr,
+			.has_this = function.has_this
+		};
+		if (!function_table_add(&module->exports, signature))
+		{
+			printf("Function '%s' is exported twice by module %s\n", symbol_name(function.name), module->name);
+			return false;
+		}
+	}
+	return true;
+}
+
+//Writes the exports to an interface file, which importers load in place of the module's source
+bool module_interface_write(ModuleDescriptor* module, const char* filepath)
+{
+	return ast_file_write_interface(module->name, module->exports.functions, filepath);
+}
+
+//Loads a module from its interface file. Only the signatures are read, names are interned and the file is closed
+//again straight away. Returns null after reporting the error if the file is not a valid interface
+ModuleDescriptor* module_interface_load(const char* filepath)
+{
+	AstFile file;
+	if (!ast_file_open(&file, filepath))
+		return nullptr;
+
+	Symbol name = SYMBOL_NONE;
+	bool result = ast_file_module_name(&file, &name);
+	if (result && (!(file.header->flags & AST_FILE_SIGNATURES_ONLY) || name == SYMBOL_NONE))
+	{
+		printf("%s is not a module interface\n", filepath);
+		result = false;
+	}
+
+	ModuleDescriptor* module = new ModuleDescriptor
+	{
+		.name = symbol_name(name)
+	};
+	for (uint32_t i = 0; result && i < file.header->function_count; i++)
+	{
+		FunctionDescriptor function;
+		result = ast_file_load_declaration(&file, i, &function);
+		if (result && !function_table_add(&module->exports, function))
+		{
+			printf("%s exports '%s' twice\n", filepath, symbol_name(function.name));
+			result = false;
+		}
+	}
+
+	ast_file_close(&file);
+	if (!result)
+	{
+		function_table_clear(&module->exports);
+		delete module;
+		return nullptr;
+	}
+	return module;
+}
+
+FunctionDescriptor* module_find_export(ModuleDescriptor* module, Symbol name)
+{
+	return function_table_find(&module->exports, name);
+}
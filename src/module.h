@@ -0,0 +1,17 @@
+#pragma once
+#include "function_table.h"
+
+struct SourceFile;
+
+//The language has no visibility yet, so every top level function of a module's files is exported
+struct ModuleDescriptor
+{
+	const char* name = nullptr;
+	//Signatures of the exported functions. Bodies are never kept, so every node is null
+	FunctionTable exports;
+};
+
+extern bool module_add_exports(ModuleDescriptor* module, SourceFile* source_file);
+extern bool module_interface_write(ModuleDescriptor* module, const char* filepath);
+extern ModuleDescriptor* module_interface_load(const char* filepath);
+extern FunctionDescriptor* module_find_export(ModuleDescriptor* module, Symbol name);
@@ -0,0 +1,249 @@
+#include "parse_cache.h"
+#include "parser.h"
+#include "ast_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+static const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t PRIME3 = 0x165667B19E3779F9ull;
+static const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+static uint64_t rotate_left(uint64_t value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t read64(const unsigned char* data)
+{
+	uint64_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static uint32_t read32(const unsigned char* data)
+{
+	uint32_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static uint64_t hash_round(uint64_t accumulator, uint64_t input)
+{
+	accumulator += input * PRIME2;
+	return rotate_left(accumulator, 31) * PRIME1;
+}
+
+static uint64_t hash_merge(uint64_t hash, uint64_t accumulator)
+{
+	hash ^= hash_round(0, accumulator);
+	return hash * PRIME1 + PRIME4;
+}
+
+//XXH64. It reads 32 bytes per step in four independent lanes, so hashing a file costs a small fraction of lexing it
+static uint64_t hash_bytes(const void* data, size_t length, uint64_t seed)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	const unsigned char* end = p + length;
+	uint64_t hash;
+
+	if (length >= 32)
+	{
+		uint64_t v1 = seed + PRIME1 + PRIME2;
+		uint64_t v2 = seed + PRIME2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - PRIME1;
+		for (; p + 32 <= end; p += 32)
+		{
+			v1 = hash_round(v1, read64(p));
+			v2 = hash_round(v2, read64(p + 8));
+			v3 = hash_round(v3, read64(p + 16));
+			v4 = hash_round(v4, read64(p + 24));
+		}
+		hash = rotate_left(v1, 1) + rotate_left(v2, 7) + rotate_left(v3, 12) + rotate_left(v4, 18);
+		hash = hash_merge(hash, v1);
+		hash = hash_merge(hash, v2);
+		hash = hash_merge(hash, v3);
+		hash = hash_merge(hash, v4);
+	}
+	else
+	{
+		hash = seed + PRIME5;
+	}
+
+	hash += length;
+	for (; p + 8 <= end; p += 8)
+		hash = rotate_left(hash ^ hash_round(0, read64(p)), 27) * PRIME1 + PRIME4;
+	if (p + 4 <= end)
+	{
+		hash = rotate_left(hash ^ (read32(p) * PRIME1), 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	for (; p < end; p++)
+		hash = rotate_left(hash ^ (*p * PRIME5), 11) * PRIME1;
+
+	hash ^= hash >> 33;
+	hash *= PRIME2;
+	hash ^= hash >> 29;
+	hash *= PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+//Hashes the source together with the parser and AST file versions, so entries written by another build of the
+//compiler never match
+uint64_t parse_cache_key(const SourceBuffer* source)
+{
+	static const uint64_t salt = hash_bytes(PARSE_CACHE_VERSION, strlen(PARSE_CACHE_VERSION), AST_FILE_VERSION);
+	return hash_bytes(source->data, source->length, salt);
+}
+
+static std::filesystem::path entry_path(ParseCache* cache, uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.ast", (unsigned long long)key);
+	return std::filesystem::path(cache->directory) / name;
+}
+
+//Fills the function table from the cache entry for key. Only the signatures are read, each body stays in the
+//mapped entry until function_node asks for it. Returns false on a miss, leaving the file untouched
+bool parse_cache_load(ParseCache* cache, SourceFile* source_file, uint64_t key)
+{
+	std::filesystem::path path = entry_path(cache, key);
+	std::error_code error;
+	if (!std::filesystem::exists(path, error))
+	{
+		cache->misses++;
+		return false;
+	}
+
+	//Broken or outdated entries are reported, then parsed again and replaced like any other miss
+	AstFile* entry = new AstFile;
+	bool result = ast_file_open(entry, path.string().c_str());
+	std::vector<FunctionDescriptor> functions(result ? entry->header->function_count : 0);
+	for (uint32_t i = 0; result && i < functions.size(); i++)
+	{
+		result = ast_file_load_declaration(entry, i, &functions[i]);
+		functions[i].body_state = BodyState::CACHED;
+		functions[i].body_begin = (int)i;
+	}
+	for (size_t i = 0; result && i < functions.size(); i++)
+		result = function_table_add(&source_file->functions, functions[i]);
+
+	if (!result)
+	{
+		function_table_clear(&source_file->functions);
+		if (entry->header)
+			ast_file_close(entry);
+		delete entry;
+		cache->misses++;
+		return false;
+	}
+
+	source_file->cache_entry = entry;
+	source_file->lazy_bodies = true;
+	if (source_file->node_allocators.empty())
+		source_file->node_allocators.push_back(nullptr);
+	cache->hits++;
+	return true;
+}
+
+//Removes the oldest entries until the cache is down to three quarters of its limit, never the one just stored, so
+//a full cache is not listed again on every store. The directory is listed rather than trusting the running size,
+//since other processes may share it
+static void evict_entries(ParseCache* cache, const std::filesystem::path& newest)
+{
+	struct Entry
+	{
+		std::filesystem::path path;
+		std::filesystem::file_time_type time;
+		uint64_t size;
+	};
+	std::vector<Entry> entries;
+	uint64_t size = 0;
+	std::error_code error;
+	for (const std::filesystem::directory_entry& item : std::filesystem::directory_iterator(cache->directory, error))
+	{
+		if (item.path().extension() != ".ast" || !item.is_regular_file(error))
+			continue;
+		Entry entry = {
+			.path = item.path(),
+			.time = item.last_write_time(error),
+			.size = item.file_size(error)
+		};
+		if (error)
+			continue;
+		size += entry.size;
+		if (entry.path != newest)
+			entries.push_back(entry);
+	}
+
+	uint64_t target = cache->size_limit - cache->size_limit / 4;
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+	for (size_t i = 0; i < entries.size() && size > target; i++)
+	{
+		if (std::filesystem::remove(entries[i].path, error))
+			size -= entries[i].size;
+	}
+	cache->size = size;
+}
+
+//Writes the parsed file as the entry for key. The AST is written to a uniquely named temporary file first and
+//renamed over the entry, so readers only ever see complete entries. Failures are reported but not fatal, the
+//file is simply parsed again next time
+void parse_cache_store(ParseCache* cache, SourceFile* source_file, uint64_t key)
+{
+	std::filesystem::path path = entry_path(cache, key);
+	std::random_device random;
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%08x%08x.tmp", random(), random());
+	std::filesystem::path temporary = path;
+	temporary += suffix;
+
+	std::error_code error;
+	std::filesystem::create_directories(cache->directory, error);
+	if (!ast_file_write(source_file, temporary.string().c_str()))
+	{
+		std::filesystem::remove(temporary, error);
+		return;
+	}
+	uint64_t size = std::filesystem::file_size(temporary, error);
+	if (error)
+		size = 0;
+	//An entry which failed to load is rewritten under the same key, and the rename replaces its bytes
+	uint64_t replaced = std::filesystem::file_size(path, error);
+	if (error)
+		replaced = 0;
+	std::filesystem::rename(temporary, path, error);
+	if (error)
+	{
+		printf("Failed to store %s in the parse cache\n", source_file->filepath);
+		std::filesystem::remove(temporary, error);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(cache->mutex);
+	if (!cache->size_known)
+	{
+		//The listing already includes the new entry
+		cache->size_known = true;
+		cache->size = 0;
+		for (const std::filesystem::directory_entry& item : std::filesystem::directory_iterator(cache->directory, error))
+			if (item.path().extension() == ".ast" && item.is_regular_file(error))
+				cache->size += item.file_size(error);
+	}
+	else
+	{
+		cache->size += size;
+		cache->size -= std::min(replaced, cache->size);
+	}
+
+	if (cache->size_limit && cache->size > cache->size_limit)
+		evict_entries(cache, path);
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include "source.h"
+
+struct SourceFile;
+
+//Bump whenever the parser would build different trees from the same source, so older cache entries stop matching
+#define PARSE_CACHE_VERSION "NewCompiler parser 1"
+
+//Directory of AST files named after a hash of the source they were parsed from. It can be shared by any number of
+//threads and processes, entries are only ever replaced whole
+struct ParseCache
+{
+	const char* directory = nullptr;
+	//Bytes the entries may take up before the oldest are removed, 0 for no limit
+	uint64_t size_limit = 0;
+	std::atomic<uint64_t> hits = 0;
+	std::atomic<uint64_t> misses = 0;
+	//Size of the directory, measured the first time an entry is stored and kept up to date after that
+	std::mutex mutex;
+	bool size_known = false;
+	uint64_t size = 0;
+};
+
+extern uint64_t parse_cache_key(const SourceBuffer* source);
+extern bool parse_cache_load(ParseCache* cache, SourceFile* source_file, uint64_t key);
+extern void parse_cache_store(ParseCache* cache, SourceFile* source_file, uint64_t key);
@@ -1,35 +1,471 @@
 #include "parser.h"
 #include "ast.h"
+#include <stdio.h>
+
+struct FunctionSpan
+{
+	int begin = 0;
+	int end = 0;
+};
+
+//Finds the tokens of every top level function by matching braces, without parsing anything. Each span ends just
+//after the brace which closes the function body
+static bool find_function_spans(const TokenStream& tokens, std::vector<FunctionSpan>& spans)
+{
+	const TokenType* types = tokens.types.data();
+	int count = tokens.size();
+	int depth = 0;
+	int begin = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (types[i] == TokenType::OPEN_BRACE)
+		{
+			depth++;
+		}
+		else if (types[i] == TokenType::CLOSE_BRACE)
+		{
+			depth--;
+			if (depth == 0)
+			{
+				spans.push_back({ .begin = begin, .end = i + 1 });
+				begin = i + 1;
+			}
+			else if (depth < 0)
+			{
+				token_error(tokens, i, "Unmatched '}'");
+				return false;
+			}
+		}
+	}
+
+	if (begin < count)
+	{
+		token_error(tokens, begin, "Unexpected end of file");
+		return false;
+	}
+	return true;
+}
+
+struct FunctionParseJob
+{
+	SourceFile* source_file;
+	const std::vector<FunctionSpan>* spans;
+	std::vector<FunctionDescriptor>* functions;
+	std::vector<char>* results;
+};
+
+static void parse_function_task(int task, int worker, void* user)
+{
+	FunctionParseJob* job = (FunctionParseJob*)user;
+	const FunctionSpan& span = (*job->spans)[task];
+	const TokenStream& tokens = job->source_file->tokens;
+
+	//Arenas are only created for the workers which end up parsing part of the file
+	NodeAllocator*& allocator = job->source_file->node_allocators[worker];
+	if (!allocator)
+		allocator = node_allocator_create();
+
+	int next = span.begin;
+	bool result = parse_function(tokens, span.begin, allocator, &(*job->functions)[task], &next);
+	if (result && next != span.end)
+	{
+		token_error(tokens, next, "Unexpected token after function body");
+		result = false;
+	}
+	(*job->results)[task] = result;
+}
+
+//Parses every function span, on the context's thread pool if it has one. Each worker allocates nodes from its own
+//arena and writes only its own slot of functions, so the output is the same as a serial parse
+static bool parse_functions(ParserContext* ctx, SourceFile* source_file, const std::vector<FunctionSpan>& spans, std::vector<FunctionDescriptor>& functions)
+{
+	ThreadPool* pool = context_thread_pool(ctx);
+	int worker_count = pool ? thread_pool_worker_count(pool) : 1;
+	if ((int)source_file->node_allocators.size() < worker_count)
+		source_file->node_allocators.resize(worker_count, nullptr);
+
+	functions.resize(spans.size());
+	std::vector<char> results(spans.size());
+	FunctionParseJob job = {
+		.source_file = source_file,
+		.spans = &spans,
+		.functions = &functions,
+		.results = &results
+	};
+
+	if (pool)
+		thread_pool_run(pool, (int)spans.size(), parse_function_task, &job);
+	else
+		for (int i = 0; i < (int)spans.size(); i++)
+			parse_function_task(i, 0, &job);
+
+	for (char result : results)
+		if (!result)
+			return false;
+	return true;
+}
+
+//Parses only the declaration of every function span and records where its body is. The bodies are left to
+//function_node
+static bool parse_declarations(SourceFile* source_file, const std::vector<FunctionSpan>& spans, std::vector<FunctionDescriptor>& functions)
+{
+	const TokenStream& tokens = source_file->tokens;
+	source_file->lazy_bodies = true;
+	if (source_file->node_allocators.empty())
+		source_file->node_allocators.push_back(nullptr);
+
+	functions.resize(spans.size());
+	for (size_t i = 0; i < spans.size(); i++)
+	{
+		FunctionDescriptor* function = &functions[i];
+		int next = spans[i].begin;
+		if (!parse_func_declaration(tokens, spans[i].begin, function, &next))
+		{
+			token_error(tokens, spans[i].begin, "Invalid function declaration");
+			return false;
+		}
+		if (next >= spans[i].end || tokens.types[next] != TokenType::OPEN_BRACE)
+		{
+			token_error(tokens, next, "Expected '{' after function declaration");
+			return false;
+		}
+
+		function->body_state = BodyState::PENDING;
+		function->body_begin = next;
+		function->body_end = spans[i].end;
+	}
+	return true;
+}
+
+//Parses every function of an already tokenized file into its function table
+bool parse_source_file(ParserContext* ctx, SourceFile* source_file)
+{
+	std::vector<FunctionSpan> spans;
+	if (!find_function_spans(source_file->tokens, spans))
+		return false;
+
+	std::vector<FunctionDescriptor> functions;
+	if (ctx->lazy_bodies)
+	{
+		if (!parse_declarations(source_file, spans, functions))
+			return false;
+	}
+	else if (!parse_functions(ctx, source_file, spans, functions))
+	{
+		puts("Failed to parse function");
+		return false;
+	}
+
+	for (int i = 0; i < (int)functions.size(); i++)
+	{
+		if (!function_table_add(&source_file->functions, functions[i]))
+		{
+			char message[256];
+			snprintf(message, sizeof(message), "Function '%s' is already defined", symbol_name(functions[i].name));
+			token_error(source_file->tokens, spans[i].begin, message);
+			return false;
+		}
+	}
+	return true;
+}
+
+//Frees a file which failed to load along with whatever it had mapped and allocated so far. parse_files carries on
+//after a failure, so nothing may be left behind
+static void free_failed_source_file(SourceFile* source_file)
+{
+	for (NodeAllocator* allocator : source_file->node_allocators)
+		if (allocator)
+			node_allocator_free(allocator);
+	if (source_file->cache_entry)
+	{
+		ast_file_close(source_file->cache_entry);
+		delete source_file->cache_entry;
+	}
+	function_table_clear(&source_file->functions);
+	source_buffer_close(&source_file->source);
+	delete source_file;
+}
+
+//Maps, lexes and parses a file, or loads it from the parse cache if the context has one. Returns null after
+//reporting the error if any step fails
+static SourceFile* load_source_file(ParserContext* ctx, const char* filepath)
+{
+	SourceFile* source_file = new SourceFile
+	{
+		.filepath = filepath
+	};
+
+	if (!source_buffer_open(&source_file->source, filepath))
+	{
+		free_failed_source_file(source_file);
+		return nullptr;
+	}
+
+	source_file->tokens.source = &source_file->source;
+	uint64_t key = ctx->cache ? parse_cache_key(&source_file->source) : 0;
+	if (!ctx->cache || !parse_cache_load(ctx->cache, source_file, key))
+	{
+		if (!tokenize_buffer_parallel(source_file->source.data, source_file->source.length, source_file->tokens, ctx->lexer_threads))
+		{
+			report_error(&source_file->source, source_file->tokens.error_offset, "Encountered unexpected token");
+			free_failed_source_file(source_file);
+			return nullptr;
+		}
+
+		if (!parse_source_file(ctx, source_file))
+		{
+			free_failed_source_file(source_file);
+			return nullptr;
+		}
+		if (ctx->cache)
+			parse_cache_store(ctx->cache, source_file, key);
+	}
+
+	if (ctx->linearize && !linearize_source_file(source_file))
+	{
+		free_failed_source_file(source_file);
+		return nullptr;
+	}
+	return source_file;
+}
 
 bool parse_file(ParserContext* ctx, const char* filepath)
 {
+	SourceFile* source_file = load_source_file(ctx, filepath);
+	if (!source_file)
+		return false;
+	context_add_source_file(ctx, source_file);
+	return true;
+}
+
+struct FileParseJob
+{
+	ParserContext* ctx;
+	const std::vector<const char*>* filepaths;
+	std::vector<SourceFile*>* source_files;
+};
+
+static void parse_file_task(int task, int worker, void* user)
+{
+	FileParseJob* job = (FileParseJob*)user;
+	(*job->source_files)[task] = load_source_file(job->ctx, (*job->filepaths)[task]);
+}
+
+//Parses many files concurrently on the context's thread pool. Files are tasks of their own and the functions of
+//each file are queued behind them, so idle workers steal functions out of large files once the small ones are done.
+//Every file is attempted even if some fail, and the files which parsed are added to the context in input order
+bool parse_files(ParserContext* ctx, const std::vector<const char*>& filepaths)
+{
+	std::vector<SourceFile*> source_files(filepaths.size());
+	FileParseJob job = {
+		.ctx = ctx,
+		.filepaths = &filepaths,
+		.source_files = &source_files
+	};
+
+	ThreadPool* pool = context_thread_pool(ctx);
+	if (pool)
+		thread_pool_run(pool, (int)filepaths.size(), parse_file_task, &job);
+	else
+		for (int i = 0; i < (int)filepaths.size(); i++)
+			parse_file_task(i, 0, &job);
+
+	bool result = true;
+	for (SourceFile* source_file : source_files)
+	{
+		if (source_file)
+			context_add_source_file(ctx, source_file);
+		else
+			result = false;
+	}
+	return result;
+}
+
+//Pulls the tokens of the next top level function, up to and including the brace which closes its body
+static bool read_function_tokens(Lexer* lexer, TokenStream& tokens)
+{
+	tokens.types.clear();
+	tokens.payloads.clear();
+	tokens.offsets.clear();
+
+	int depth = 0;
+	Token token;
+	while (lexer_next_token(lexer, &token))
+	{
+		token_stream_push(tokens, token);
+		if (token.type == TokenType::OPEN_BRACE)
+		{
+			depth++;
+		}
+		else if (token.type == TokenType::CLOSE_BRACE)
+		{
+			depth--;
+			if (depth == 0)
+				return true;
+		}
+	}
+	return false;
+}
+
+//Parses the file one function at a time straight from the streaming lexer. Only the tokens of the current function are
+//kept and the node allocator is reset after on_function returns, so memory use is bounded by the largest function
+bool parse_file_streamed(ParserContext* ctx, const char* filepath, FunctionCallback on_function, void* user)
+{
+	Lexer lexer;
+	if (!lexer_open(&lexer, filepath))
+		return false;
+
 	SourceFile* source_file = new SourceFile
 	{
 		.filepath = filepath,
-		.node_allocator = node_allocator_create()
+		.node_allocators = { node_allocator_create() }
 	};
 
-	if (!tokenize_file(filepath, source_file->tokens))
+	bool result = true;
+	while (true)
 	{
-		printf("Failed to tokenize file %s", filepath);
-		return false;
+		bool complete = read_function_tokens(&lexer, source_file->tokens);
+		if (lexer.failed)
+		{
+			printf("%s: Encountered unexpected token at offset %u\n", filepath, lexer.error_offset);
+			result = false;
+			break;
+		}
+		if (source_file->tokens.size() == 0)
+			break;
+		if (!complete)
+		{
+			puts("Unexpected end of file");
+			result = false;
+			break;
+		}
+
+		int index = 0;
+		FunctionDescriptor func = {};
+		if (!parse_function(source_file->tokens, 0, source_file->node_allocators[0], &func, &index))
+		{
+			puts("Failed to parse function");
+			result = false;
+			break;
+		}
+
+		on_function(&func, user);
+		node_allocator_reset(source_file->node_allocators[0]);
 	}
 
-	int index = 0;
-	FunctionDescriptor func = {};
-	if (!parse_function(source_file->tokens, 0, source_file->node_allocator, &func, &index))
+	lexer_close(&lexer);
+	context_add_source_file(ctx, source_file);
+	return result;
+}
+
+//Returns the body of a function, parsing it first if the file was parsed with lazy bodies or rebuilding it if the
+//file came from the parse cache. Bodies made on demand are allocated from the file's first arena under the file's lock, so this can be called from any thread
+bool function_node(SourceFile* source_file, FunctionDescriptor* function, Node** node)
+{
+	//The pointer trees are gone once the file is linearized
+	if (source_file->linearized)
 	{
-		puts("Failed to parse function");
+		*node = nullptr;
 		return false;
 	}
 
-	print_tree(nullptr, func.node);
+	if (!source_file->lazy_bodies)
+	{
+		*node = function->node;
+		return function->body_state == BodyState::PARSED;
+	}
 
-	ctx->source_files.push_back(source_file);
+	std::lock_guard<std::mutex> lock(source_file->mutex);
+	if (function->body_state == BodyState::PENDING || function->body_state == BodyState::CACHED)
+	{
+		NodeAllocator*& allocator = source_file->node_allocators[0];
+		if (!allocator)
+			allocator = node_allocator_create();
+		if (function->body_state == BodyState::PENDING)
+			parse_function_body(source_file->tokens, allocator, function);
+		else if (ast_file_load_body(source_file->cache_entry, function->body_begin, allocator, &function->node))
+			function->body_state = BodyState::PARSED;
+		else
+			function->body_state = BodyState::FAILED;
+	}
+
+	*node = function->node;
+	return function->body_state == BodyState::PARSED;
+}
+
+//Copies the tree of every function into a post-order CompactTree and frees the node arenas. Pending lazy bodies
+//are parsed first. Returns false if one of them fails to parse, in which case the file is left as it was
+bool linearize_source_file(SourceFile* source_file)
+{
+	std::vector<FunctionDescriptor>& functions = source_file->functions.functions;
+	for (FunctionDescriptor& function : functions)
+	{
+		Node* node;
+		if (!function_node(source_file, &function, &node))
+			return false;
+	}
+
+	source_file->trees.resize(functions.size());
+	for (size_t i = 0; i < functions.size(); i++)
+	{
+		compact_tree_build(&source_file->trees[i], functions[i].node, NodeOrder::POST_ORDER);
+		functions[i].node = nullptr;
+	}
+
+	for (NodeAllocator* allocator : source_file->node_allocators)
+		if (allocator)
+			node_allocator_free(allocator);
+	source_file->node_allocators.clear();
+	//Every body has been rebuilt, so the cache entry is no longer needed
+	if (source_file->cache_entry)
+	{
+		ast_file_close(source_file->cache_entry);
+		delete source_file->cache_entry;
+		source_file->cache_entry = nullptr;
+	}
+	source_file->linearized = true;
 	return true;
 }
 
+//Resets every field by hand since the mutex makes the context impossible to assign
 void init_context(ParserContext* ctx)
 {
-    *ctx = {};
+	ctx->current_module = nullptr;
+	ctx->current_file = nullptr;
+	ctx->module_descriptors.clear();
+	ctx->source_files.clear();
+	ctx->lexer_threads = 1;
+	ctx->parser_threads = 1;
+	ctx->lazy_bodies = false;
+	ctx->linearize = false;
+	ctx->cache = nullptr;
+	ctx->thread_pool = nullptr;
+}
+
+//Returns the pool shared by every parse in the context, creating it on first use. Null if parsing is serial
+ThreadPool* context_thread_pool(ParserContext* ctx)
+{
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+	if (ctx->parser_threads != 1 && !ctx->thread_pool)
+		ctx->thread_pool = thread_pool_create(ctx->parser_threads);
+	return ctx->thread_pool;
+}
+
+void context_add_source_file(ParserContext* ctx, SourceFile* source_file)
+{
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+	ctx->source_files.push_back(source_file);
+}
+
+void context_add_module(ParserContext* ctx, ModuleDescriptor* module)
+{
+	std::lock_guard<std::mutex> lock(ctx->mutex);
+	ctx->module_descriptors.push_back(module);
+}
+
+void free_context(ParserContext* ctx)
+{
+	if (ctx->thread_pool)
+		thread_pool_free(ctx->thread_pool);
+	ctx->thread_pool = nullptr;
 }
@@ -1,27 +1,67 @@
 #pragma once
 #include <vector>
+#include <mutex>
 #include "tokenize.h"
 #include "ast.h"
-
-struct ModuleDescriptor
-{
-	const char* name = nullptr;
-};
+#include "source.h"
+#include "function_table.h"
+#include "thread_pool.h"
+#include "compact_ast.h"
+#include "ast_file.h"
+#include "parse_cache.h"
+#include "module.h"
 
 struct SourceFile
 {
 	const char* filepath = nullptr;
-	NodeAllocator* node_allocator = nullptr;
-	std::vector<Token*> tokens;
+	SourceBuffer source;
+	//One arena per parser worker, created when the worker first parses part of the file. The function trees of the
+	//file live in all of them
+	std::vector<NodeAllocator*> node_allocators;
+	TokenStream tokens;
+	FunctionTable functions;
+	//Set when the function bodies are parsed on demand by function_node, which locks the mutex while it does
+	bool lazy_bodies = false;
+	//Set once linearize_source_file has replaced the node arenas with one post-order tree per function, stored in
+	//the same order as the function table
+	bool linearized = false;
+	std::vector<CompactTree> trees;
+	//Mapped parse cache entry the functions were loaded from, null if the file was parsed
+	AstFile* cache_entry = nullptr;
+	std::mutex mutex;
 };
 
+//The lists are shared between parser threads and must only be changed through the context_add functions
 struct ParserContext
 {
-	ModuleDescriptor* current_module;
-	SourceFile* current_file;
+	ModuleDescriptor* current_module = nullptr;
+	SourceFile* current_file = nullptr;
 	std::vector<ModuleDescriptor*> module_descriptors;
 	std::vector<SourceFile*> source_files;
+	//Threads used to lex each file, 0 picks one per core
+	int lexer_threads = 1;
+	//Threads used to parse files and their functions, 0 picks one per core
+	int parser_threads = 1;
+	//Only parse function declarations up front and leave the bodies until function_node asks for them
+	bool lazy_bodies = false;
+	//Linearize every file once it is parsed
+	bool linearize = false;
+	//Cache of parsed files, null to always parse
+	ParseCache* cache = nullptr;
+	ThreadPool* thread_pool = nullptr;
+	std::mutex mutex;
 };
 
+typedef void (*FunctionCallback)(FunctionDescriptor* function, void* user);
+
 extern bool parse_file(ParserContext* ctx, const char* filepath);
+extern bool parse_files(ParserContext* ctx, const std::vector<const char*>& filepaths);
+extern bool parse_source_file(ParserContext* ctx, SourceFile* source_file);
+extern bool parse_file_streamed(ParserContext* ctx, const char* filepath, FunctionCallback on_function, void* user);
+extern bool function_node(SourceFile* source_file, FunctionDescriptor* function, Node** node);
+extern bool linearize_source_file(SourceFile* source_file);
 extern void init_context(ParserContext* ctx);
+extern void free_context(ParserContext* ctx);
+extern ThreadPool* context_thread_pool(ParserContext* ctx);
+extern void context_add_source_file(ParserContext* ctx, SourceFile* source_file);
+extern void context_add_module(ParserContext* ctx, ModuleDescriptor* module);
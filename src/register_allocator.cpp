@@ -0,0 +1,248 @@
+#include "register_allocator.h"
+#include <functional>
+#include <queue>
+#include <utility>
+
+static const IrRegister NO_REGISTER = UINT32_MAX;
+
+//Live interval of a virtual register in instruction positions. Instruction i reads its operands at 2i and writes
+//its result at 2i + 1, so a register last read by an instruction is free again for the one it defines
+struct LiveInterval
+{
+	uint32_t start = UINT32_MAX;
+	uint32_t end = 0;
+	//A spilled register is reloaded for each read and stored for each write. A parameter is written on entry
+	uint32_t reads = 0;
+	uint32_t writes = 0;
+	//Source of the MOV which first defines the register, whose machine register it would like to share
+	IrRegister hint = NO_REGISTER;
+};
+
+//A spilled interval holding a slot until its end
+typedef std::pair<uint32_t, uint32_t> SlotUse;
+
+struct Allocator
+{
+	const IrFunction* ir;
+	IrAllocation* allocation;
+	std::vector<LiveInterval> intervals;
+	//Registers in order of their interval's start
+	std::vector<IrRegister> order;
+	//Instructions which are MOVs
+	std::vector<uint32_t> moves;
+	//Registers holding a machine register, ordered by the end of their interval
+	std::vector<IrRegister> active;
+	//Virtual register in each allocatable machine register
+	std::vector<IrRegister> owners;
+	std::vector<uint32_t> free_slots;
+	std::priority_queue<SlotUse, std::vector<SlotUse>, std::greater<SlotUse>> slot_uses;
+};
+
+static LiveInterval& touch(Allocator* allocator, IrRegister reg, uint32_t position)
+{
+	LiveInterval& interval = allocator->intervals[reg];
+	if (interval.start == UINT32_MAX)
+	{
+		interval.start = position;
+		allocator->order.push_back(reg);
+	}
+	interval.end = position;
+	return interval;
+}
+
+//Control only moves forward, so a register can only be live between its first and its last mention: any read
+//after a point comes later in layout order. One pass over the instructions finds every interval, in order of their
+//start. Parameters are live from the entry
+static void build_intervals(Allocator* allocator)
+{
+	const IrFunction* ir = allocator->ir;
+	allocator->intervals.assign(ir->register_count, {});
+	for (IrRegister parameter = 0; parameter < ir->parameter_count; parameter++)
+		touch(allocator, parameter, 0).writes++;
+
+	for (uint32_t i = 0; i < ir->instructions.size(); i++)
+	{
+		const IrInstruction& instruction = ir->instructions[i];
+		IrRegister uses[2];
+		int use_count = ir_uses(instruction, uses);
+		for (int u = 0; u < use_count; u++)
+			touch(allocator, uses[u], i * 2).reads++;
+		if (instruction.op == IrOp::CALL)
+		{
+			const IrCall& call = ir->calls[instruction.a];
+			for (uint32_t a = 0; a < call.argument_count; a++)
+				touch(allocator, ir->arguments[call.first_argument + a], i * 2).reads++;
+		}
+
+		if (!ir_defines(instruction.op))
+			continue;
+		if (instruction.op == IrOp::MOV)
+		{
+			allocator->moves.push_back(i);
+			if (allocator->intervals[instruction.dst].start == UINT32_MAX)
+				allocator->intervals[instruction.dst].hint = instruction.a;
+		}
+		touch(allocator, instruction.dst, i * 2 + 1).writes++;
+	}
+}
+
+//True if spilling a costs less than spilling b: fewer accesses for each position it would keep a register busy
+static bool cheaper_to_spill(const LiveInterval& a, const LiveInterval& b)
+{
+	uint64_t a_length = a.end - a.start + 1;
+	uint64_t b_length = b.end - b.start + 1;
+	return (uint64_t)(a.reads + a.writes) * b_length < (uint64_t)(b.reads + b.writes) * a_length;
+}
+
+//A register spilled when its interval starts can reuse the slot of an interval which has already ended. One
+//spilled later already holds its value somewhere before now, so it always gets a new slot
+static void spill(Allocator* allocator, IrRegister reg, bool at_start)
+{
+	IrAllocation* allocation = allocator->allocation;
+	uint32_t slot;
+	if (at_start && !allocator->free_slots.empty())
+	{
+		slot = allocator->free_slots.back();
+		allocator->free_slots.pop_back();
+	}
+	else
+	{
+		slot = allocation->spill_slots++;
+	}
+	allocation->locations[reg] = { .spilled = true, .index = slot };
+	allocation->spilled_registers++;
+	allocator->slot_uses.push({ allocator->intervals[reg].end, slot });
+}
+
+static void activate(Allocator* allocator, IrRegister reg, uint32_t machine_register)
+{
+	allocator->allocation->locations[reg] = { .spilled = false, .index = machine_register };
+	allocator->owners[machine_register] = reg;
+	std::vector<IrRegister>& active = allocator->active;
+	uint32_t end = allocator->intervals[reg].end;
+	size_t i = active.size();
+	active.push_back(reg);
+	for (; i > 0 && allocator->intervals[active[i - 1]].end > end; i--)
+		active[i] = active[i - 1];
+	active[i] = reg;
+}
+
+//Linear scan over the intervals in order of their start. Each interval takes the machine register of its hint if
+//that is free, so MOVs between them disappear, or else any free one. With none free, the cheapest of the new
+//interval and the active ones to spill is spilled for its whole length. The active list never holds more than
+//the machine registers, so allocation is linear in the number of instructions
+static void scan(Allocator* allocator, uint32_t available)
+{
+	IrAllocation* allocation = allocator->allocation;
+	std::vector<IrRegister>& active = allocator->active;
+	allocator->owners.assign(available, NO_REGISTER);
+	for (IrRegister reg : allocator->order)
+	{
+		const LiveInterval& interval = allocator->intervals[reg];
+		size_t expired = 0;
+		while (expired < active.size() && allocator->intervals[active[expired]].end < interval.start)
+			allocator->owners[allocation->locations[active[expired++]].index] = NO_REGISTER;
+		active.erase(active.begin(), active.begin() + expired);
+		while (!allocator->slot_uses.empty() && allocator->slot_uses.top().first < interval.start)
+		{
+			allocator->free_slots.push_back(allocator->slot_uses.top().second);
+			allocator->slot_uses.pop();
+		}
+
+		uint32_t machine_register = UINT32_MAX;
+		if (interval.hint != NO_REGISTER && !allocation->locations[interval.hint].spilled &&
+			allocator->owners[allocation->locations[interval.hint].index] == NO_REGISTER)
+			machine_register = allocation->locations[interval.hint].index;
+		for (uint32_t r = 0; machine_register == UINT32_MAX && r < available; r++)
+			if (allocator->owners[r] == NO_REGISTER)
+				machine_register = r;
+		if (machine_register != UINT32_MAX)
+		{
+			activate(allocator, reg, machine_register);
+			continue;
+		}
+
+		size_t victim = 0;
+		for (size_t i = 1; i < active.size(); i++)
+			if (cheaper_to_spill(allocator->intervals[active[i]], allocator->intervals[active[victim]]))
+				victim = i;
+		if (!cheaper_to_spill(allocator->intervals[active[victim]], interval))
+		{
+			spill(allocator, reg, true);
+			continue;
+		}
+		IrRegister spilled = active[victim];
+		machine_register = allocation->locations[spilled].index;
+		active.erase(active.begin() + victim);
+		spill(allocator, spilled, false);
+		activate(allocator, reg, machine_register);
+	}
+}
+
+//Counts the memory accesses and moves the allocation implies
+static void count_costs(Allocator* allocator)
+{
+	const IrFunction* ir = allocator->ir;
+	IrAllocation* allocation = allocator->allocation;
+	const std::vector<IrLocation>& locations = allocation->locations;
+	for (IrRegister reg = 0; reg < locations.size(); reg++)
+	{
+		if (!locations[reg].spilled)
+			continue;
+		allocation->spill_loads += allocator->intervals[reg].reads;
+		allocation->spill_stores += allocator->intervals[reg].writes;
+	}
+
+	for (uint32_t i : allocator->moves)
+	{
+		const IrLocation& source = locations[ir->instructions[i].a];
+		const IrLocation& destination = locations[ir->instructions[i].dst];
+		if (!source.spilled && !destination.spilled && source.index == destination.index)
+			allocation->moves_removed++;
+	}
+}
+
+//Assigns every virtual register of the function a machine register or a spill slot. machine_registers includes
+//the scratch registers spilled operands are reloaded into. The intervals assume control never jumps backwards,
+//which holds as long as the language has no loops
+bool allocate_registers(const IrFunction* ir, uint32_t machine_registers, IrAllocation* allocation)
+{
+	*allocation = {};
+	if (machine_registers <= ALLOCATOR_SCRATCH_REGISTERS)
+	{
+		printf("The register allocator needs more than %d machine registers\n", ALLOCATOR_SCRATCH_REGISTERS);
+		return false;
+	}
+	for (uint32_t b = 0; b < ir->blocks.size(); b++)
+	{
+		const IrInstruction& last = ir->instructions[ir->blocks[b].first + ir->blocks[b].count - 1];
+		if ((last.op == IrOp::JUMP && last.a <= b) || (last.op == IrOp::BRANCH_ZERO && last.b <= b))
+		{
+			printf("%s: block %u jumps backwards, which the register allocator does not support\n", symbol_name(ir->name), b);
+			return false;
+		}
+	}
+
+	Allocator allocator = {
+		.ir = ir,
+		.allocation = allocation
+	};
+	allocation->locations.assign(ir->register_count, {});
+	build_intervals(&allocator);
+	scan(&allocator, machine_registers - ALLOCATOR_SCRATCH_REGISTERS);
+	count_costs(&allocator);
+	return true;
+}
+
+void print_allocation(FILE* file, const IrFunction* ir, const IrAllocation* allocation)
+{
+	fprintf(file, "allocation %s (%u spilled in %u slots, %u reloads, %u spill stores, %u moves removed)\n",
+		symbol_name(ir->name), allocation->spilled_registers, allocation->spill_slots, allocation->spill_loads,
+		allocation->spill_stores, allocation->moves_removed);
+	for (IrRegister reg = 0; reg < allocation->locations.size(); reg++)
+	{
+		const IrLocation& location = allocation->locations[reg];
+		if (location.index != IR_LOCATION_UNUSED)
+			fprintf(file, location.spilled ? "\tr%u = spill%u\n" : "\tr%u = m%u\n", reg, location.index);
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "ir.h"
+
+//Machine registers kept free for reloading spilled operands, an instruction reads at most two registers
+#define ALLOCATOR_SCRATCH_REGISTERS 2
+
+//Index of a register no instruction mentions, such as one left behind by reduce_multiplies. It holds nothing and
+//takes no machine register or slot
+#define IR_LOCATION_UNUSED UINT32_MAX
+
+//Where a virtual register lives for its whole interval: a machine register, or a stack slot if it was spilled
+struct IrLocation
+{
+	bool spilled = false;
+	uint32_t index = IR_LOCATION_UNUSED;
+};
+
+struct IrAllocation
+{
+	std::vector<IrLocation> locations;
+	uint32_t spill_slots = 0;
+	uint32_t spilled_registers = 0;
+	//Memory accesses the allocation adds: a reload per read of a spilled register, a store per write to one
+	uint32_t spill_loads = 0;
+	uint32_t spill_stores = 0;
+	//MOVs whose source and destination ended up in the same machine register
+	uint32_t moves_removed = 0;
+};
+
+extern bool allocate_registers(const IrFunction* ir, uint32_t machine_registers, IrAllocation* allocation);
+extern void print_allocation(FILE* file, const IrFunction* ir, const IrAllocation* allocation);
@@ -0,0 +1,217 @@
+#include "source.h"
+#include <stdio.h>
+#include <algorithm>
+#include <mutex>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SOURCE_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+bool source_buffer_open(SourceBuffer* buffer, const char* filepath)
+{
+	*buffer = {};
+	HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		printf("Failed to open file %s", filepath);
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		printf("Failed to read size of file %s", filepath);
+		return false;
+	}
+
+	//Empty files cannot be mapped
+	if (size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		buffer->filepath = filepath;
+		buffer->data = "";
+		return true;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const char* data = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!data)
+	{
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		printf("Failed to map file %s", filepath);
+		return false;
+	}
+
+	buffer->filepath = filepath;
+	buffer->data = data;
+	buffer->length = (size_t)size.QuadPart;
+	buffer->file_handle = file;
+	buffer->mapping_handle = mapping;
+	return true;
+}
+
+void source_buffer_close(SourceBuffer* buffer)
+{
+	if (buffer->mapping_handle)
+	{
+		UnmapViewOfFile(buffer->data);
+		CloseHandle(buffer->mapping_handle);
+		CloseHandle(buffer->file_handle);
+	}
+	delete buffer->line_starts;
+	*buffer = {};
+}
+#else
+bool source_buffer_open(SourceBuffer* buffer, const char* filepath)
+{
+	*buffer = {};
+	int fd = open(filepath, O_RDONLY);
+	if (fd < 0)
+	{
+		printf("Failed to open file %s", filepath);
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0)
+	{
+		close(fd);
+		printf("Failed to read size of file %s", filepath);
+		return false;
+	}
+
+	//Empty files cannot be mapped
+	if (info.st_size == 0)
+	{
+		close(fd);
+		buffer->filepath = filepath;
+		buffer->data = "";
+		return true;
+	}
+
+	void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	//The mapping keeps its own reference to the file
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		printf("Failed to map file %s", filepath);
+		return false;
+	}
+	madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+	buffer->filepath = filepath;
+	buffer->data = (const char*)data;
+	buffer->length = (size_t)info.st_size;
+	return true;
+}
+
+void source_buffer_close(SourceBuffer* buffer)
+{
+	if (buffer->length)
+		munmap((void*)buffer->data, buffer->length);
+	delete buffer->line_starts;
+	*buffer = {};
+}
+#endif
+
+static int popcount(uint32_t mask)
+{
+#ifdef _MSC_VER
+	return (int)__popcnt(mask);
+#else
+	return __builtin_popcount(mask);
+#endif
+}
+
+static int lowest_bit(uint32_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+static size_t count_newlines(const char* data, size_t length)
+{
+	size_t count = 0;
+	size_t i = 0;
+#ifdef SOURCE_HAS_SSE2
+	__m128i newline = _mm_set1_epi8('\n');
+	for (; i + 16 <= length; i += 16)
+		count += popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i)), newline)));
+#endif
+	for (; i < length; i++)
+		count += data[i] == '\n';
+	return count;
+}
+
+//The newlines are counted first so the index is allocated at its exact size
+static void build_line_starts(const char* data, size_t length, std::vector<uint32_t>& line_starts)
+{
+	line_starts.reserve(count_newlines(data, length) + 1);
+	line_starts.push_back(0);
+
+	size_t i = 0;
+#ifdef SOURCE_HAS_SSE2
+	__m128i newline = _mm_set1_epi8('\n');
+	for (; i + 16 <= length; i += 16)
+	{
+		uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i)), newline));
+		while (mask)
+		{
+			line_starts.push_back((uint32_t)(i + lowest_bit(mask) + 1));
+			mask &= mask - 1;
+		}
+	}
+#endif
+	for (; i < length; i++)
+		if (data[i] == '\n')
+			line_starts.push_back((uint32_t)(i + 1));
+}
+
+//Rows and columns are one based. Locations are only needed for diagnostics, so the index is built the first time one is
+//asked for rather than tracking lines while lexing
+SourceLocation source_location(SourceBuffer* buffer, uint32_t offset)
+{
+	static std::mutex build_mutex;
+	std::vector<uint32_t>* line_starts;
+	{
+		std::lock_guard<std::mutex> lock(build_mutex);
+		if (!buffer->line_starts)
+		{
+			buffer->line_starts = new std::vector<uint32_t>();
+			build_line_starts(buffer->data, buffer->length, *buffer->line_starts);
+		}
+		line_starts = buffer->line_starts;
+	}
+
+	auto line = std::upper_bound(line_starts->begin(), line_starts->end(), offset) - 1;
+	return {
+		.row = (int)(line - line_starts->begin()) + 1,
+		.column = (int)(offset - *line) + 1
+	};
+}
+
+void report_error(SourceBuffer* buffer, uint32_t offset, const char* message)
+{
+	SourceLocation location = source_location(buffer, offset);
+	printf("%s:%i:%i: %s\n", buffer->filepath, location.row, location.column, message);
+}
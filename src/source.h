@@ -0,0 +1,30 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct SourceLocation
+{
+	int row = 0;
+	int column = 0;
+};
+
+//Read only view of a source file. The contents are memory mapped and stay valid until source_buffer_close,
+//so tokens and later passes can refer to the text by offset instead of copying it
+struct SourceBuffer
+{
+	const char* filepath = nullptr;
+	const char* data = nullptr;
+	size_t length = 0;
+	//Offset of the first byte of every line, only built once a location is asked for
+	std::vector<uint32_t>* line_starts = nullptr;
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#endif
+};
+
+extern bool source_buffer_open(SourceBuffer* buffer, const char* filepath);
+extern void source_buffer_close(SourceBuffer* buffer);
+extern SourceLocation source_location(SourceBuffer* buffer, uint32_t offset);
+extern void report_error(SourceBuffer* buffer, uint32_t offset, const char* message);
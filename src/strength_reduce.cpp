@@ -0,0 +1,327 @@
+#include "strength_reduce.h"
+#include <unordered_map>
+#include <utility>
+
+//Step of a shift and add sequence. Operands are values, 0 being the multiplicand and i + 1 the result of step i
+struct ShiftStep
+{
+	IrOp op;
+	//Shift amount, or the value of a CONST
+	int16_t value;
+	uint16_t a;
+	uint16_t b;
+};
+
+struct ShiftSequence
+{
+	std::vector<ShiftStep> steps;
+	int cycles = 0;
+};
+
+//Cheapest sequence found for each multiplier. They only depend on the cost model, so they are kept for every
+//function the thread reduces
+typedef std::unordered_map<uint16_t, ShiftSequence> SequenceCache;
+static thread_local SequenceCache best_sequences;
+static thread_local SequenceCache chosen_sequences;
+
+//A multiply to replace, with the sequence computing it or null if both operands are constant
+struct Rewrite
+{
+	uint32_t instruction;
+	const ShiftSequence* sequence;
+};
+
+struct Reducer
+{
+	IrFunction* ir;
+	//Registers holding the same constant wherever they are read, and their values
+	std::vector<uint8_t> known;
+	std::vector<uint16_t> values;
+	//Index of the single definition of each known register
+	std::vector<uint32_t> definitions;
+	std::vector<uint32_t> uses;
+	//Known registers whose definition is dropped since nothing reads them after the rewrites
+	std::vector<uint8_t> dead;
+	std::vector<uint32_t> multiplies;
+	std::vector<Rewrite> rewrites;
+};
+
+//The value the sequence computes
+static uint16_t result_value(const ShiftSequence* sequence)
+{
+	return (uint16_t)sequence->steps.size();
+}
+
+static uint16_t add_step(ShiftSequence* sequence, IrOp op, uint16_t a, uint16_t b, int16_t value)
+{
+	sequence->steps.push_back({ .op = op, .value = value, .a = a, .b = b });
+	sequence->cycles += ir_cycles({ .op = op, .value = value });
+	return result_value(sequence);
+}
+
+static uint16_t add_negate(ShiftSequence* sequence, uint16_t value)
+{
+	uint16_t zero = add_step(sequence, IrOp::CONST, 0, 0, 0);
+	return add_step(sequence, IrOp::SUB, zero, value, 0);
+}
+
+static bool cheaper(const ShiftSequence& a, const ShiftSequence& b)
+{
+	return a.cycles < b.cycles || (a.cycles == b.cycles && a.steps.size() < b.steps.size());
+}
+
+//Horner evaluation of the multiplier's non-adjacent form, the signed binary digits with no two nonzero digits next
+//to each other. A run of ones costs an add and a subtract instead of an add per bit
+static ShiftSequence digit_sequence(uint16_t multiplier)
+{
+	int digits[17] = {};
+	uint32_t n = multiplier;
+	for (int i = 0; n; i++, n >>= 1)
+	{
+		if (!(n & 1))
+			continue;
+		digits[i] = (n & 3) == 1 ? 1 : -1;
+		n = digits[i] > 0 ? n - 1 : n + 1;
+	}
+
+	//The top digit can reach bit 16, which shifts out of a word
+	ShiftSequence sequence;
+	int top = 15;
+	while (top >= 0 && !digits[top])
+		top--;
+	if (top < 0)
+	{
+		add_step(&sequence, IrOp::CONST, 0, 0, 0);
+		return sequence;
+	}
+
+	uint16_t value = digits[top] > 0 ? 0 : add_negate(&sequence, 0);
+	int position = top;
+	for (int i = top - 1; i >= 0; i--)
+	{
+		if (!digits[i])
+			continue;
+		value = add_step(&sequence, IrOp::SHL, value, 0, (int16_t)(position - i));
+		value = add_step(&sequence, digits[i] > 0 ? IrOp::ADD : IrOp::SUB, value, 0, 0);
+		position = i;
+	}
+	if (position)
+		add_step(&sequence, IrOp::SHL, value, 0, (int16_t)position);
+	return sequence;
+}
+
+//The cheapest of the digit sequence and the factorings of the multiplier. Even multipliers shift the sequence of
+//their odd part, odd ones try every factor of the form 2^k + 1 or 2^k - 1, so 45 is computed as (x * 15) * 3 in
+//four steps. Factors are always smaller than the multiplier, which bounds the recursion by its bit count
+static const ShiftSequence& best_sequence(uint16_t multiplier)
+{
+	SequenceCache::iterator found = best_sequences.find(multiplier);
+	if (found != best_sequences.end())
+		return found->second;
+
+	ShiftSequence best = digit_sequence(multiplier);
+	if (multiplier > 1 && !(multiplier & 1))
+	{
+		int shift = 0;
+		while (!((multiplier >> shift) & 1))
+			shift++;
+		ShiftSequence sequence = best_sequence((uint16_t)(multiplier >> shift));
+		add_step(&sequence, IrOp::SHL, result_value(&sequence), 0, (int16_t)shift);
+		if (cheaper(sequence, best))
+			best = std::move(sequence);
+	}
+	else if (multiplier > 1)
+	{
+		for (int k = 1; k < 16; k++)
+		{
+			for (int sign = -1; sign <= 1; sign += 2)
+			{
+				uint32_t factor = (1u << k) + sign;
+				if (factor <= 1 || factor >= multiplier || multiplier % factor)
+					continue;
+				ShiftSequence sequence = best_sequence((uint16_t)(multiplier / factor));
+				uint16_t inner = result_value(&sequence);
+				uint16_t shifted = add_step(&sequence, IrOp::SHL, inner, 0, (int16_t)k);
+				add_step(&sequence, sign > 0 ? IrOp::ADD : IrOp::SUB, shifted, inner, 0);
+				if (cheaper(sequence, best))
+					best = std::move(sequence);
+			}
+		}
+	}
+	return best_sequences[multiplier] = std::move(best);
+}
+
+//Negative multipliers also try negating the product by their magnitude
+static const ShiftSequence& choose_sequence(uint16_t multiplier)
+{
+	SequenceCache::iterator found = chosen_sequences.find(multiplier);
+	if (found != chosen_sequences.end())
+		return found->second;
+
+	ShiftSequence best = best_sequence(multiplier);
+	if ((int16_t)multiplier < 0)
+	{
+		ShiftSequence sequence = best_sequence((uint16_t)-multiplier);
+		add_negate(&sequence, result_value(&sequence));
+		if (cheaper(sequence, best))
+			best = std::move(sequence);
+	}
+	return chosen_sequences[multiplier] = std::move(best);
+}
+
+//Finds the registers with a single definition which is a CONST, or a MOV of another such register. Every read of
+//them sees that value, since without loops a definition comes before its reads in layout order. Parameters hold
+//their argument until they are first assigned and never qualify. Also counts the reads of every register and
+//collects the multiplies
+static void find_constants(Reducer* reducer)
+{
+	IrFunction* ir = reducer->ir;
+	std::vector<uint8_t> counts(ir->register_count);
+	for (const IrInstruction& instruction : ir->instructions)
+		if (ir_defines(instruction.op) && counts[instruction.dst] < 2)
+			counts[instruction.dst]++;
+
+	reducer->known.assign(ir->register_count, false);
+	reducer->values.assign(ir->register_count, 0);
+	reducer->definitions.assign(ir->register_count, 0);
+	reducer->uses.assign(ir->register_count, 0);
+	for (uint32_t i = 0; i < ir->instructions.size(); i++)
+	{
+		const IrInstruction& instruction = ir->instructions[i];
+		IrRegister operands[2];
+		int count = ir_uses(instruction, operands);
+		for (int u = 0; u < count; u++)
+			reducer->uses[operands[u]]++;
+		if (instruction.op == IrOp::MUL)
+			reducer->multiplies.push_back(i);
+
+		if (!ir_defines(instruction.op) || instruction.dst < ir->parameter_count || counts[instruction.dst] != 1)
+			continue;
+		if (instruction.op == IrOp::CONST)
+			reducer->values[instruction.dst] = (uint16_t)instruction.value;
+		else if (instruction.op == IrOp::MOV && reducer->known[instruction.a])
+			reducer->values[instruction.dst] = reducer->values[instruction.a];
+		else
+			continue;
+		reducer->known[instruction.dst] = true;
+		reducer->definitions[instruction.dst] = i;
+	}
+	for (IrRegister argument : ir->arguments)
+		reducer->uses[argument]++;
+}
+
+//Drops a read of a known register. Once it has none left its definition goes too, and with a MOV the read of
+//its source
+static void release_constant(Reducer* reducer, IrRegister constant)
+{
+	while (!--reducer->uses[constant])
+	{
+		reducer->dead[constant] = true;
+		const IrInstruction& definition = reducer->ir->instructions[reducer->definitions[constant]];
+		if (definition.op != IrOp::MOV)
+			break;
+		constant = definition.a;
+	}
+}
+
+//Picks the multiplies to replace: those by a constant whose sequence ir_cycles says is cheaper than the
+//multiplier, and those of two constants
+static void choose_rewrites(Reducer* reducer)
+{
+	reducer->dead.assign(reducer->ir->register_count, false);
+	for (uint32_t index : reducer->multiplies)
+	{
+		const IrInstruction& instruction = reducer->ir->instructions[index];
+		bool known_a = reducer->known[instruction.a];
+		bool known_b = reducer->known[instruction.b];
+		if (known_a && known_b)
+		{
+			reducer->rewrites.push_back({ .instruction = index });
+			release_constant(reducer, instruction.a);
+			release_constant(reducer, instruction.b);
+			continue;
+		}
+		if (!known_a && !known_b)
+			continue;
+
+		IrRegister constant = known_b ? instruction.b : instruction.a;
+		const ShiftSequence& sequence = choose_sequence(reducer->values[constant]);
+		if (sequence.cycles >= ir_cycles(instruction))
+			continue;
+		reducer->rewrites.push_back({ .instruction = index, .sequence = &sequence });
+		release_constant(reducer, constant);
+	}
+}
+
+static void emit_rewrite(Reducer* reducer, std::vector<IrInstruction>* instructions, const Rewrite& rewrite)
+{
+	const IrInstruction& instruction = reducer->ir->instructions[rewrite.instruction];
+	if (!rewrite.sequence)
+	{
+		uint16_t product = (uint16_t)(reducer->values[instruction.a] * reducer->values[instruction.b]);
+		instructions->push_back({ .op = IrOp::CONST, .value = (int16_t)product, .dst = instruction.dst });
+		return;
+	}
+
+	const ShiftSequence& sequence = *rewrite.sequence;
+	IrRegister multiplicand = reducer->known[instruction.b] ? instruction.a : instruction.b;
+	if (sequence.steps.empty())
+	{
+		instructions->push_back({ .op = IrOp::MOV, .dst = instruction.dst, .a = multiplicand });
+		return;
+	}
+
+	std::vector<IrRegister> registers(sequence.steps.size() + 1);
+	registers[0] = multiplicand;
+	for (size_t i = 0; i < sequence.steps.size(); i++)
+	{
+		const ShiftStep& step = sequence.steps[i];
+		registers[i + 1] = i + 1 == sequence.steps.size() ? instruction.dst : reducer->ir->register_count++;
+		instructions->push_back({
+			.op = step.op,
+			.value = step.value,
+			.dst = registers[i + 1],
+			.a = step.op == IrOp::CONST ? 0 : registers[step.a],
+			.b = step.op == IrOp::ADD || step.op == IrOp::SUB ? registers[step.b] : 0
+		});
+	}
+}
+
+//Replaces multiplications by a constant with shifts, adds and subtracts where ir_cycles says the sequence is
+//cheaper than the multiplier, and multiplications of two constants with their product. The definitions of the
+//constants which are no longer read are dropped, but a block is never emptied. Returns the number of
+//multiplies replaced
+size_t reduce_multiplies(IrFunction* ir)
+{
+	Reducer reducer = { .ir = ir };
+	find_constants(&reducer);
+	choose_rewrites(&reducer);
+	if (reducer.rewrites.empty())
+		return 0;
+
+	std::vector<IrInstruction> instructions;
+	instructions.reserve(ir->instructions.size() + reducer.rewrites.size() * 4);
+	size_t next_rewrite = 0;
+	for (IrBlock& block : ir->blocks)
+	{
+		uint32_t first = (uint32_t)instructions.size();
+		uint32_t end = block.first + block.count;
+		for (uint32_t i = block.first; i < end; i++)
+		{
+			const IrInstruction& instruction = ir->instructions[i];
+			if (next_rewrite < reducer.rewrites.size() && reducer.rewrites[next_rewrite].instruction == i)
+				emit_rewrite(&reducer, &instructions, reducer.rewrites[next_rewrite++]);
+			else if (!ir_defines(instruction.op) || !reducer.dead[instruction.dst])
+				instructions.push_back(instruction);
+			else if (i + 1 == end && instructions.size() == first)
+			{
+				//The source of a MOV may be gone, so the value is loaded directly
+				instructions.push_back({ .op = IrOp::CONST, .value = (int16_t)reducer.values[instruction.dst], .dst = instruction.dst });
+			}
+		}
+		block.first = first;
+		block.count = (uint32_t)instructions.size() - first;
+	}
+	ir->instructions = std::move(instructions);
+	return reducer.rewrites.size();
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include <stddef.h>
+#include "ir.h"
+
+extern size_t reduce_multiplies(IrFunction* ir);
@@ -0,0 +1,140 @@
+#include "thread_pool.h"
+
+static thread_local ThreadPool* current_pool = nullptr;
+static thread_local int current_worker = 0;
+
+static bool pop_task(ThreadPool* pool, int worker, Task* task)
+{
+	WorkerQueue* queue = &pool->queues[worker];
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	if (queue->tasks.empty())
+		return false;
+	*task = queue->tasks.back();
+	queue->tasks.pop_back();
+	return true;
+}
+
+static bool steal_task(ThreadPool* pool, int victim, Task* task)
+{
+	WorkerQueue* queue = &pool->queues[victim];
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	if (queue->tasks.empty())
+		return false;
+	*task = queue->tasks.front();
+	queue->tasks.pop_front();
+	return true;
+}
+
+//Takes the newest task of the worker's own queue, or failing that the oldest task of another worker
+static bool find_task(ThreadPool* pool, int worker, Task* task)
+{
+	if (pool->queued.load(std::memory_order_acquire) == 0)
+		return false;
+
+	bool found = pop_task(pool, worker, task);
+	for (int i = 1; !found && i < pool->worker_count; i++)
+		found = steal_task(pool, (worker + i) % pool->worker_count, task);
+
+	if (found)
+		pool->queued.fetch_sub(1, std::memory_order_relaxed);
+	return found;
+}
+
+static void execute_task(const Task& task, int worker)
+{
+	task.function(task.index, worker, task.user);
+	task.group->pending.fetch_sub(1, std::memory_order_release);
+}
+
+static void worker_main(ThreadPool* pool, int worker)
+{
+	current_pool = pool;
+	current_worker = worker;
+	while (true)
+	{
+		Task task;
+		if (find_task(pool, worker, &task))
+		{
+			execute_task(task, worker);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(pool->sleep_mutex);
+		pool->wake.wait(lock, [&]() { return pool->stop || pool->queued.load(std::memory_order_acquire) > 0; });
+		if (pool->stop)
+			return;
+	}
+}
+
+//Creates a pool which runs tasks on thread_count threads including the caller's, 0 picks one per core
+ThreadPool* thread_pool_create(int thread_count)
+{
+	if (thread_count <= 0)
+		thread_count = (int)std::thread::hardware_concurrency();
+	if (thread_count <= 0)
+		thread_count = 1;
+
+	ThreadPool* pool = new ThreadPool();
+	pool->worker_count = thread_count;
+	pool->queues = new WorkerQueue[thread_count];
+	for (int i = 1; i < thread_count; i++)
+		pool->threads.emplace_back(worker_main, pool, i);
+	return pool;
+}
+
+void thread_pool_free(ThreadPool* pool)
+{
+	{
+		std::lock_guard<std::mutex> lock(pool->sleep_mutex);
+		pool->stop = true;
+	}
+	pool->wake.notify_all();
+	for (std::thread& thread : pool->threads)
+		thread.join();
+	delete[] pool->queues;
+	delete pool;
+}
+
+int thread_pool_worker_count(const ThreadPool* pool)
+{
+	return pool->worker_count;
+}
+
+//Queues every task on the calling worker and returns once all of them have finished. The caller keeps running
+//tasks while it waits, which lets tasks start more tasks of their own without tying up a thread. Only one thread
+//outside the pool may call this at a time, since it works as worker 0
+void thread_pool_run(ThreadPool* pool, int task_count, TaskFunction function, void* user)
+{
+	int worker = current_pool == pool ? current_worker : 0;
+	if (pool->worker_count == 1 || task_count <= 1)
+	{
+		for (int i = 0; i < task_count; i++)
+			function(i, worker, user);
+		return;
+	}
+
+	TaskGroup group;
+	group.pending.store(task_count, std::memory_order_relaxed);
+	{
+		WorkerQueue* queue = &pool->queues[worker];
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		for (int i = task_count - 1; i >= 0; i--)
+			queue->tasks.push_back({ .function = function, .user = user, .index = i, .group = &group });
+	}
+	pool->queued.fetch_add(task_count, std::memory_order_release);
+
+	//Taking the lock orders the new tasks against workers which are about to sleep, so none of them miss the wake up
+	{
+		std::lock_guard<std::mutex> lock(pool->sleep_mutex);
+	}
+	pool->wake.notify_all();
+
+	while (group.pending.load(std::memory_order_acquire) > 0)
+	{
+		Task task;
+		if (find_task(pool, worker, &task))
+			execute_task(task, worker);
+		else
+			std::this_thread::yield();
+	}
+}
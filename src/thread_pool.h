@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <vector>
+
+//Runs task with every index below task_count. worker identifies the thread running it, from 0 (the thread outside
+//the pool which called thread_pool_run) up to thread_pool_worker_count - 1, so tasks can use per worker state
+//without locking
+typedef void (*TaskFunction)(int task, int worker, void* user);
+
+struct TaskGroup
+{
+	std::atomic<int> pending = 0;
+};
+
+struct Task
+{
+	TaskFunction function = nullptr;
+	void* user = nullptr;
+	int index = 0;
+	TaskGroup* group = nullptr;
+};
+
+//Every worker pushes and pops its own tasks at the back and steals from the front of the others
+struct WorkerQueue
+{
+	std::mutex mutex;
+	std::deque<Task> tasks;
+};
+
+struct ThreadPool
+{
+	std::vector<std::thread> threads;
+	WorkerQueue* queues = nullptr;
+	int worker_count = 0;
+	std::atomic<int> queued = 0;
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	bool stop = false;
+};
+
+extern ThreadPool* thread_pool_create(int thread_count);
+extern void thread_pool_free(ThreadPool* pool);
+extern int thread_pool_worker_count(const ThreadPool* pool);
+extern void thread_pool_run(ThreadPool* pool, int task_count, TaskFunction function, void* user);
@@ -1,266 +1,633 @@
 #include "tokenize.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <iostream>
+#include <limits.h>
+#include <thread>
 
-bool tokenize_file(const char* filepath, std::vector<Token*>& tokens)
+#define CHAR_SPACE 1
+#define CHAR_IDENT_START 2
+#define CHAR_IDENT 4
+#define CHAR_DIGIT 8
+#define CHAR_PUNCT 16
+
+#define TOKEN_TYPE_NONE 0xFF
+
+struct CharTable
+{
+	uint8_t classes[256] = {};
+	//Token type of every single character token, TOKEN_TYPE_NONE for anything else
+	uint8_t punct[256] = {};
+};
+
+static constexpr CharTable build_char_table()
 {
-	FILE* file = fopen(filepath, "rb");
-	if (!file)
+	CharTable table = {};
+	for (int c = 0; c < 256; c++)
+		table.punct[c] = TOKEN_TYPE_NONE;
+
+	const char* spaces = " \t\n\r\v\f";
+	for (const char* c = spaces; *c; c++)
+		table.classes[(uint8_t)*c] = CHAR_SPACE;
+	for (int c = 'a'; c <= 'z'; c++)
+		table.classes[c] = CHAR_IDENT_START | CHAR_IDENT;
+	for (int c = 'A'; c <= 'Z'; c++)
+		table.classes[c] = CHAR_IDENT_START | CHAR_IDENT;
+	for (int c = '0'; c <= '9'; c++)
+		table.classes[c] = CHAR_DIGIT | CHAR_IDENT;
+	table.classes['_'] = CHAR_IDENT;
+
+	struct { char c; TokenType type; } puncts[] =
 	{
-		printf("Failed to open file %s", filepath);
-		return false;
+		{ '+', TokenType::PLUS },
+		{ '-', TokenType::MINUS },
+		{ ')', TokenType::CLOSE_PAREN },
+		{ '(', TokenType::OPEN_PAREN },
+		{ '}', TokenType::CLOSE_BRACE },
+		{ '{', TokenType::OPEN_BRACE },
+		{ '=', TokenType::EQUALS },
+		{ '*', TokenType::STAR },
+		{ '&', TokenType::AMP },
+		{ ';', TokenType::SEMICOLON },
+		{ ':', TokenType::COLON },
+		{ ',', TokenType::COMMA },
+	};
+	for (auto& p : puncts)
+	{
+		table.classes[(uint8_t)p.c] = CHAR_PUNCT;
+		table.punct[(uint8_t)p.c] = (uint8_t)p.type;
 	}
+	return table;
+}
+
+static constexpr CharTable char_table = build_char_table();
+
+struct Keyword
+{
+	const char* spelling;
+	size_t length;
+	TokenType type;
+};
+
+static constexpr Keyword keywords[] =
+{
+	{ "void", 4, TokenType::VOID },
+	{ "s16", 3, TokenType::S16 },
+	{ "else", 4, TokenType::ELSE },
+	{ "if", 2, TokenType::IF },
+};
 
-	fseek(file, 0, SEEK_END);
-	long length = ftell(file);
-	fseek(file, 0, SEEK_SET);
+#define KEYWORD_TABLE_SIZE 16
 
-	char* buffer = new char[length + 1];
-	if (fread(buffer, sizeof(char), length, file) != length)
+//Perfect hash over the keyword set, checked for collisions at compile time below
+static constexpr uint32_t keyword_hash(const char* str, size_t length)
+{
+	return ((uint8_t)str[0] * 31 + (uint8_t)str[length - 1] + (uint32_t)length) & (KEYWORD_TABLE_SIZE - 1);
+}
+
+struct KeywordTable
+{
+	//Index into keywords plus one, zero marks an empty slot
+	uint8_t slots[KEYWORD_TABLE_SIZE] = {};
+	bool perfect = true;
+};
+
+static constexpr KeywordTable build_keyword_table()
+{
+	KeywordTable table = {};
+	for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++)
 	{
-		delete[] buffer;
-		printf("Failed to read entire file %s", filepath);
+		uint32_t slot = keyword_hash(keywords[i].spelling, keywords[i].length);
+		if (table.slots[slot])
+			table.perfect = false;
+		table.slots[slot] = (uint8_t)(i + 1);
+	}
+	return table;
+}
+
+static constexpr KeywordTable keyword_table = build_keyword_table();
+static_assert(keyword_table.perfect, "keyword_hash has a collision, adjust it for the current keyword set");
+
+static bool keyword_lookup(const char* str, size_t length, TokenType* type)
+{
+	uint8_t slot = keyword_table.slots[keyword_hash(str, length)];
+	if (!slot)
 		return false;
+	const Keyword& keyword = keywords[slot - 1];
+	if (keyword.length != length || memcmp(keyword.spelling, str, length))
+		return false;
+	*type = keyword.type;
+	return true;
+}
+
+//Each scanner returns the first byte at or after begin which is not part of the run it scans for
+static const char* scan_class_scalar(const char* begin, const char* end, uint8_t char_class)
+{
+	while (begin < end && (char_table.classes[(uint8_t)*begin] & char_class))
+		begin++;
+	return begin;
+}
+
+static const char* scan_whitespace_scalar(const char* begin, const char* end)
+{
+	return scan_class_scalar(begin, end, CHAR_SPACE);
+}
+
+static const char* scan_identifier_scalar(const char* begin, const char* end)
+{
+	return scan_class_scalar(begin, end, CHAR_IDENT);
+}
+
+static const char* scan_digits_scalar(const char* begin, const char* end)
+{
+	return scan_class_scalar(begin, end, CHAR_DIGIT);
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TOKENIZE_HAS_SIMD 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+static int lowest_bit(uint32_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+//Unsigned range checks are done by biasing into the signed range, since SSE2 only has signed byte compares
+#define SSE_IN_RANGE(x, lo, hi) _mm_cmpgt_epi8(_mm_set1_epi8((char)(0x80 + (hi) - (lo) + 1)), _mm_add_epi8((x), _mm_set1_epi8((char)(0x80 - (lo)))))
+#define AVX_IN_RANGE(x, lo, hi) _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(0x80 + (hi) - (lo) + 1)), _mm256_add_epi8((x), _mm256_set1_epi8((char)(0x80 - (lo)))))
+
+static __m128i sse_whitespace(__m128i x)
+{
+	return _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), SSE_IN_RANGE(x, '\t', '\r'));
+}
+
+static __m128i sse_identifier(__m128i x)
+{
+	__m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+	__m128i alpha = SSE_IN_RANGE(lower, 'a', 'z');
+	__m128i digit = SSE_IN_RANGE(x, '0', '9');
+	return _mm_or_si128(_mm_or_si128(alpha, digit), _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+}
+
+static __m128i sse_digits(__m128i x)
+{
+	return SSE_IN_RANGE(x, '0', '9');
+}
+
+//Most runs in real code are only a few bytes long, so the first byte is checked before paying for a vector load
+#define DEFINE_SSE_SCANNER(name, predicate, scalar, char_class) \
+static const char* name(const char* begin, const char* end) \
+{ \
+	if (begin < end && !(char_table.classes[(uint8_t)*begin] & char_class)) \
+		return begin; \
+	while (end - begin >= 16) \
+	{ \
+		__m128i x = _mm_loadu_si128((const __m128i*)begin); \
+		uint32_t outside = ~(uint32_t)_mm_movemask_epi8(predicate(x)) & 0xFFFF; \
+		if (outside) \
+			return begin + lowest_bit(outside); \
+		begin += 16; \
+	} \
+	return scalar(begin, end); \
+}
+
+DEFINE_SSE_SCANNER(scan_whitespace_sse2, sse_whitespace, scan_whitespace_scalar, CHAR_SPACE)
+DEFINE_SSE_SCANNER(scan_identifier_sse2, sse_identifier, scan_identifier_scalar, CHAR_IDENT)
+DEFINE_SSE_SCANNER(scan_digits_sse2, sse_digits, scan_digits_scalar, CHAR_DIGIT)
+
+TARGET_AVX2 static __m256i avx_whitespace(__m256i x)
+{
+	return _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), AVX_IN_RANGE(x, '\t', '\r'));
+}
+
+TARGET_AVX2 static __m256i avx_identifier(__m256i x)
+{
+	__m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+	__m256i alpha = AVX_IN_RANGE(lower, 'a', 'z');
+	__m256i digit = AVX_IN_RANGE(x, '0', '9');
+	return _mm256_or_si256(_mm256_or_si256(alpha, digit), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+}
+
+TARGET_AVX2 static __m256i avx_digits(__m256i x)
+{
+	return AVX_IN_RANGE(x, '0', '9');
+}
+
+//Runs shorter than a vector are common, so the tail is handed to the SSE2 scanner rather than the scalar one
+#define DEFINE_AVX2_SCANNER(name, predicate, tail, char_class) \
+TARGET_AVX2 static const char* name(const char* begin, const char* end) \
+{ \
+	if (begin < end && !(char_table.classes[(uint8_t)*begin] & char_class)) \
+		return begin; \
+	while (end - begin >= 32) \
+	{ \
+		__m256i x = _mm256_loadu_si256((const __m256i*)begin); \
+		uint32_t outside = ~(uint32_t)_mm256_movemask_epi8(predicate(x)); \
+		if (outside) \
+			return begin + lowest_bit(outside); \
+		begin += 32; \
+	} \
+	return tail(begin, end); \
+}
+
+DEFINE_AVX2_SCANNER(scan_whitespace_avx2, avx_whitespace, scan_whitespace_sse2, CHAR_SPACE)
+DEFINE_AVX2_SCANNER(scan_identifier_avx2, avx_identifier, scan_identifier_sse2, CHAR_IDENT)
+DEFINE_AVX2_SCANNER(scan_digits_avx2, avx_digits, scan_digits_sse2, CHAR_DIGIT)
+
+static bool cpu_has_avx2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	//AVX2 also needs the OS to save the upper halves of the ymm registers
+	if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+struct Scanner
+{
+	ScanMode mode;
+	const char* (*whitespace)(const char* begin, const char* end);
+	const char* (*identifier)(const char* begin, const char* end);
+	const char* (*digits)(const char* begin, const char* end);
+};
+
+static Scanner make_scanner(ScanMode mode)
+{
+	switch (mode)
+	{
+#ifdef TOKENIZE_HAS_SIMD
+	case ScanMode::SSE2:
+		return { mode, scan_whitespace_sse2, scan_identifier_sse2, scan_digits_sse2 };
+	case ScanMode::AVX2:
+		return { mode, scan_whitespace_avx2, scan_identifier_avx2, scan_digits_avx2 };
+#endif
 	}
-	buffer[length] = 0;
-	fclose(file);
+	return { ScanMode::SCALAR, scan_whitespace_scalar, scan_identifier_scalar, scan_digits_scalar };
+}
+
+ScanMode scan_mode_best()
+{
+#ifdef TOKENIZE_HAS_SIMD
+	if (cpu_has_avx2())
+		return ScanMode::AVX2;
+	return ScanMode::SSE2;
+#else
+	return ScanMode::SCALAR;
+#endif
+}
 
-	char* buffer_begin = buffer;
-	char* buffer_end = buffer + length;
+static Scanner scanner = make_scanner(scan_mode_best());
+
+//Falls back to the best mode the cpu supports if the requested one is unavailable, returns the mode now in use
+ScanMode tokenize_set_scan_mode(ScanMode mode)
+{
+	if (mode > scan_mode_best())
+		mode = scan_mode_best();
+	scanner = make_scanner(mode);
+	return scanner.mode;
+}
 
-	while (buffer_begin < buffer_end)
+ScanMode tokenize_scan_mode()
+{
+	return scanner.mode;
+}
+
+TokenFlags token_flags(TokenType type)
+{
+	switch (type)
 	{
-		if (isspace(*buffer_begin))
-		{
-			buffer_begin++;
-			continue;
-		}
-		if (!strncmp("void", buffer_begin, 4) && buffer_end - buffer_begin > 4 && !isalnum(*(buffer_begin + 4)))
-		{
-			Token* t = new Token
-			{
-				.type = TokenType::VOID
-			};
-			tokens.push_back(t);
-			buffer_begin += 4;
-			continue;
-		}
-		if (!strncmp("s16", buffer_begin, 3) && buffer_end - buffer_begin > 3 && !isalnum(*(buffer_begin + 3)))
-		{
-			Token* t = new Token
-			{
-				.type = TokenType::S16
-			};
-			tokens.push_back(t);
-			buffer_begin += 3;
-			continue;
-		}
-		if (!strncmp("else", buffer_begin, 4) && buffer_end - buffer_begin > 4 && !isalnum(*(buffer_begin + 4)))
-		{
-			Token* t = new Token
-			{
-				.type = TokenType::ELSE
-			};
-			tokens.push_back(t);
-			buffer_begin += 4;
-			continue;
-		}
-		if (!strncmp("if", buffer_begin, 2) && buffer_end - buffer_begin > 2 && !isalnum(*(buffer_begin + 2)))
-		{
-			Token* t = new Token
-			{
-				.type = TokenType::IF
-			};
-			tokens.push_back(t);
-			buffer_begin += 2;
-			continue;
-		}
-		if (!strncmp("->", buffer_begin, 2) && buffer_end - buffer_begin > 2)
-		{
-			Token* t = new Token
-			{
-				.type = TokenType::ARROW
-			};
-			tokens.push_back(t);
-			buffer_begin += 2;
-			continue;
-		}
-		if (*buffer_begin == ',')
-		{
-			Token* t = new Token
-			{
-				.type = TokenType::COMMA,
-				.flags = TOKEN_FLAG_OPERATOR
-			};
-			tokens.push_back(t);
-			buffer_begin += 1;
-			continue;
-		}
-		if (*buffer_begin == ':')
-		{
-			Token* t = new Token
-			{
-				.type = TokenType::COLON,
-			};
-			tokens.push_back(t);
-			buffer_begin += 1;
-			continue;
-		}
-		if (*buffer_begin == ';')
-		{
-			Token* t = new Token
-			{
-				.type = TokenType::SEMICOLON,
-				.flags = TOKEN_FLAG_OPERATOR
-			};
-			tokens.push_back(t);
-			buffer_begin += 1;
-			continue;
-		}
-		if (*buffer_begin == '+')
-		{
-			Token* t = new Token
-			{
-				.type = TokenType::PLUS,
-				.flags = TOKEN_FLAG_OPERATOR
-			};
-			tokens.push_back(t);
-			buffer_begin += 1;
-			continue;
-		}
-		if (*buffer_begin == '-')
-		{
-			Token* t = new Token
-			{
-				.type = TokenType::MINUS,
-				.flags = TOKEN_FLAG_OPERATOR
-			};
-			tokens.push_back(t);
-			buffer_begin += 1;
-			continue;
-		}
-		if (*buffer_begin == '*')
-		{
-			Token* t = new Token
-			{
-				.type = TokenType::STAR,
-				.flags = TOKEN_FLAG_OPERATOR
-			};
-			tokens.push_back(t);
-			buffer_begin += 1;
-			continue;
-		}
-		if (*buffer_begin == '{')
+	case TokenType::PLUS:
+	case TokenType::MINUS:
+	case TokenType::STAR:
+	case TokenType::AMP:
+	case TokenType::EQUALS:
+	case TokenType::COMMA:
+	case TokenType::SEMICOLON:
+		return TOKEN_FLAG_OPERATOR;
+	}
+	return 0;
+}
+
+//Reports an error at the token, or at the end of the input if index is past the last token
+void token_error(const TokenStream& tokens, int index, const char* message)
+{
+	if (tokens.size() == 0)
+	{
+		puts(message);
+		return;
+	}
+
+	uint32_t offset = index < tokens.size() ? tokens.offsets[index] : tokens.offsets[tokens.size() - 1];
+	if (tokens.source)
+		report_error(tokens.source, offset, message);
+	else
+		printf("offset %u: %s\n", offset, message);
+}
+
+void token_stream_push(TokenStream& tokens, const Token& token)
+{
+	tokens.types.push_back(token.type);
+	tokens.payloads.push_back(token.payload);
+	tokens.offsets.push_back(token.offset);
+}
+
+enum class LexResult
+{
+	TOKEN,
+	NEED_MORE,
+	FAILED,
+};
+
+//Lexes the token starting at begin, which must not be whitespace. Unless final is set, a token which runs into end
+//may continue in data that has not been read yet, in which case NEED_MORE is returned
+static LexResult lex_token(const char* begin, const char* end, bool final, const char** next, Token* token)
+{
+	uint8_t c = (uint8_t)*begin;
+	uint8_t char_class = char_table.classes[c];
+
+	if (char_class & CHAR_PUNCT)
+	{
+		TokenType type = (TokenType)char_table.punct[c];
+		if (type == TokenType::MINUS)
 		{
-			Token* t = new Token
+			if (begin + 1 == end && !final)
+				return LexResult::NEED_MORE;
+			if (begin + 1 < end && begin[1] == '>')
 			{
-				.type = TokenType::OPEN_BRACE
-			};
-			tokens.push_back(t);
-			buffer_begin += 1;
-			continue;
+				token->type = TokenType::ARROW;
+				*next = begin + 2;
+				return LexResult::TOKEN;
+			}
 		}
-		if (*buffer_begin == '}')
+		token->type = type;
+		*next = begin + 1;
+		return LexResult::TOKEN;
+	}
+
+	if (char_class & CHAR_DIGIT)
+	{
+		const char* digits_end = scanner.digits(begin + 1, end);
+		if (digits_end == end && !final)
+			return LexResult::NEED_MORE;
+
+		unsigned long long value = 0;
+		for (const char* digit = begin; digit < digits_end; digit++)
 		{
-			Token* t = new Token
-			{
-				.type = TokenType::CLOSE_BRACE
-			};
-			tokens.push_back(t);
-			buffer_begin += 1;
-			continue;
+			//Saturates like strtol so huge literals cannot wrap
+			if (value > LONG_MAX / 10)
+				value = (unsigned long long)LONG_MAX + 1;
+			else
+				value = value * 10 + (*digit - '0');
 		}
-		if (*buffer_begin == '(')
+		if (value > LONG_MAX)
+			value = LONG_MAX;
+
+		token->type = TokenType::INT_LITERAL;
+		token->payload.parsed_int = (long)value;
+		*next = digits_end;
+		return LexResult::TOKEN;
+	}
+
+	if (char_class & CHAR_IDENT_START)
+	{
+		const char* identifier_end = scanner.identifier(begin + 1, end);
+		if (identifier_end == end && !final)
+			return LexResult::NEED_MORE;
+
+		size_t identifier_length = identifier_end - begin;
+		*next = identifier_end;
+		if (keyword_lookup(begin, identifier_length, &token->type))
+			return LexResult::TOKEN;
+
+		token->type = TokenType::IDENTIFIER;
+		token->payload.name = intern(begin, identifier_length);
+		return LexResult::TOKEN;
+	}
+
+	return LexResult::FAILED;
+}
+
+//Lexes [begin, end) with offsets measured from buffer
+static bool tokenize_range(const char* buffer, const char* begin, const char* end, TokenStream& tokens)
+{
+	//Typical sources average a little over 2 bytes per token, so this avoids regrowing the arrays in most cases
+	size_t expected_tokens = (end - begin) / 2 + 16;
+	tokens.types.reserve(expected_tokens);
+	tokens.payloads.reserve(expected_tokens);
+	tokens.offsets.reserve(expected_tokens);
+
+	while (true)
+	{
+		begin = scanner.whitespace(begin, end);
+		if (begin == end)
+			return true;
+
+		Token token = { .offset = (uint32_t)(begin - buffer) };
+		if (lex_token(begin, end, true, &begin, &token) != LexResult::TOKEN)
 		{
-			Token* t = new Token
-			{
-				.type = TokenType::OPEN_PAREN
-			};
-			tokens.push_back(t);
-			buffer_begin += 1;
-			continue;
+			tokens.error_offset = token.offset;
+			return false;
 		}
-		if (*buffer_begin == ')')
+		token_stream_push(tokens, token);
+	}
+}
+
+bool tokenize_buffer(const char* buffer, size_t length, TokenStream& tokens)
+{
+	return tokenize_range(buffer, buffer, buffer + length, tokens);
+}
+
+//Splits the buffer into one chunk per thread and lexes them concurrently. The language has no string literals or
+//comments, so any whitespace byte is a token boundary and chunks can be cut at the first one after the even split point
+bool tokenize_buffer_parallel(const char* buffer, size_t length, TokenStream& tokens, int thread_count)
+{
+	if (thread_count <= 0)
+		thread_count = (int)std::thread::hardware_concurrency();
+	if ((size_t)thread_count > length / TOKENIZE_MIN_CHUNK_SIZE)
+		thread_count = (int)(length / TOKENIZE_MIN_CHUNK_SIZE);
+	if (thread_count <= 1)
+		return tokenize_buffer(buffer, length, tokens);
+
+	const char* buffer_end = buffer + length;
+	std::vector<const char*> splits(thread_count + 1);
+	splits[0] = buffer;
+	for (int i = 1; i < thread_count; i++)
+	{
+		const char* split = buffer + length * i / thread_count;
+		if (split < splits[i - 1])
+			split = splits[i - 1];
+		while (split < buffer_end && !(char_table.classes[(uint8_t)*split] & CHAR_SPACE))
+			split++;
+		splits[i] = split;
+	}
+	splits[thread_count] = buffer_end;
+
+	std::vector<TokenStream> chunks(thread_count);
+	std::vector<char> results(thread_count);
+	std::vector<std::thread> threads;
+	for (int i = 1; i < thread_count; i++)
+		threads.emplace_back([&, i]() { results[i] = tokenize_range(buffer, splits[i], splits[i + 1], chunks[i]); });
+	results[0] = tokenize_range(buffer, splits[0], splits[1], chunks[0]);
+	for (std::thread& thread : threads)
+		thread.join();
+
+	size_t total = 0;
+	for (int i = 0; i < thread_count; i++)
+	{
+		if (!results[i])
 		{
-			Token* t = new Token
-			{
-				.type = TokenType::CLOSE_PAREN
-			};
-			tokens.push_back(t);
-			buffer_begin += 1;
-			continue;
+			tokens.error_offset = chunks[i].error_offset;
+			return false;
 		}
-		if (*buffer_begin == '=')
+		total += chunks[i].types.size();
+	}
+
+	tokens.types.reserve(tokens.types.size() + total);
+	tokens.payloads.reserve(tokens.payloads.size() + total);
+	tokens.offsets.reserve(tokens.offsets.size() + total);
+	for (TokenStream& chunk : chunks)
+	{
+		tokens.types.insert(tokens.types.end(), chunk.types.begin(), chunk.types.end());
+		tokens.payloads.insert(tokens.payloads.end(), chunk.payloads.begin(), chunk.payloads.end());
+		tokens.offsets.insert(tokens.offsets.end(), chunk.offsets.begin(), chunk.offsets.end());
+	}
+	return true;
+}
+
+bool lexer_open(Lexer* lexer, const char* filepath)
+{
+	*lexer = {};
+	lexer->file = fopen(filepath, "rb");
+	if (!lexer->file)
+	{
+		printf("Failed to open file %s", filepath);
+		return false;
+	}
+
+	lexer->capacity = LEXER_CHUNK_SIZE;
+	lexer->buffer = (char*)malloc(lexer->capacity);
+	return true;
+}
+
+void lexer_close(Lexer* lexer)
+{
+	if (lexer->file)
+		fclose(lexer->file);
+	free(lexer->buffer);
+	*lexer = {};
+}
+
+//Discards consumed input and reads the next chunk behind whatever part of a token is still pending
+static bool lexer_refill(Lexer* lexer)
+{
+	size_t pending = lexer->end - lexer->begin;
+	memmove(lexer->buffer, lexer->buffer + lexer->begin, pending);
+	lexer->buffer_offset += lexer->begin;
+	lexer->begin = 0;
+	lexer->end = pending;
+
+	//Only a single token longer than a chunk can make the buffer grow
+	if (lexer->capacity - pending < LEXER_CHUNK_SIZE)
+	{
+		lexer->capacity *= 2;
+		lexer->buffer = (char*)realloc(lexer->buffer, lexer->capacity);
+	}
+
+	size_t read = fread(lexer->buffer + lexer->end, 1, LEXER_CHUNK_SIZE, lexer->file);
+	lexer->end += read;
+	if (read < LEXER_CHUNK_SIZE)
+	{
+		if (ferror(lexer->file))
 		{
-			Token* t = new Token
-			{
-				.type = TokenType::EQUALS,
-				.flags = TOKEN_FLAG_OPERATOR
-			};
-			tokens.push_back(t);
-			buffer_begin += 1;
-			continue;
+			puts("Failed to read source file");
+			return false;
 		}
-		if (*buffer_begin == '&')
+		lexer->eof = true;
+	}
+	return true;
+}
+
+static bool lexer_lex(Lexer* lexer, Token* token)
+{
+	while (!lexer->failed)
+	{
+		const char* begin = lexer->buffer + lexer->begin;
+		const char* end = lexer->buffer + lexer->end;
+		begin = scanner.whitespace(begin, end);
+		lexer->begin = begin - lexer->buffer;
+
+		LexResult result = LexResult::NEED_MORE;
+		const char* next = nullptr;
+		*token = { .offset = (uint32_t)(lexer->buffer_offset + lexer->begin) };
+		if (begin < end)
+			result = lex_token(begin, end, lexer->eof, &next, token);
+
+		if (result == LexResult::TOKEN)
 		{
-			Token* t = new Token
-			{
-				.type = TokenType::AMP,
-				.flags = TOKEN_FLAG_OPERATOR
-			};
-			tokens.push_back(t);
-			buffer_begin += 1;
-			continue;
+			lexer->begin = next - lexer->buffer;
+			return true;
 		}
-		if (isdigit(*buffer_begin))
-		{
-			char* next = nullptr;
-			long value = strtol(buffer_begin, &next, 10);
-			buffer_begin = next;
 
-			Token* t = new Token
-			{
-				.type = TokenType::INT_LITERAL,
-				.parsed_int = value
-			};
-			tokens.push_back(t);
-			continue;
+		if (result == LexResult::FAILED)
+		{
+			lexer->failed = true;
+			lexer->error_offset = token->offset;
 		}
+		else if (lexer->eof)
+			return false;
+		else if (!lexer_refill(lexer))
+			lexer->failed = true;
+	}
+	return false;
+}
 
-		if (isalpha(*buffer_begin))
-		{
-			const char* old_begin = buffer_begin;
-			int identifer_length = 1;
-			buffer_begin++;
-			while (buffer_begin < buffer_end)
-			{
-				if (*buffer_begin == '_' || isalnum(*buffer_begin))
-				{
-					buffer_begin++;
-					continue;
-				}
-				break;
-			}
-			int length = buffer_begin - old_begin;
-			char* name = new char[length + 1];
-			memcpy(name, old_begin, length);
-			name[length] = 0;
+//Returns the token distance tokens ahead of the next one, or nullptr if the input ends before it
+const Token* lexer_peek(Lexer* lexer, int distance)
+{
+	if (distance >= LEXER_LOOKAHEAD)
+		return nullptr;
 
-			Token* t = new Token
-			{
-				.type = TokenType::IDENTIFIER,
-				.name = name
-			};
-			tokens.push_back(t);
-			continue;
-		}
+	while (lexer->lookahead_count <= distance)
+	{
+		Token* token = &lexer->lookahead[(lexer->lookahead_begin + lexer->lookahead_count) % LEXER_LOOKAHEAD];
+		if (!lexer_lex(lexer, token))
+			return nullptr;
+		lexer->lookahead_count++;
+	}
+	return &lexer->lookahead[(lexer->lookahead_begin + distance) % LEXER_LOOKAHEAD];
+}
 
-		puts("Encountered unexpected token");
-		delete[] buffer;
+bool lexer_next_token(Lexer* lexer, Token* token)
+{
+	const Token* next = lexer_peek(lexer, 0);
+	if (!next)
 		return false;
-	}
 
-	delete[] buffer;
+	*token = *next;
+	lexer->lookahead_begin = (lexer->lookahead_begin + 1) % LEXER_LOOKAHEAD;
+	lexer->lookahead_count--;
 	return true;
 }
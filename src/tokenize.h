@@ -1,11 +1,15 @@
 #pragma once
+#include <stdint.h>
+#include <stdio.h>
 #include <vector>
 #include <optional>
+#include "intern.h"
+#include "source.h"
 
 #define TOKEN_FLAG_OPERATOR 1
 typedef uint32_t TokenFlags;
 
-enum class TokenType
+enum class TokenType : uint8_t
 {
 	PLUS,
 	MINUS,
@@ -28,14 +32,76 @@ enum class TokenType
 	ELSE,
 };
 
+union TokenPayload
+{
+	long parsed_int;
+	Symbol name;
+};
+
+//Tokens are stored as parallel arrays so the parser only has to walk the dense type array while matching.
+//Payloads are only meaningful for INT_LITERAL and IDENTIFIER tokens, offsets are byte offsets into the source file
+struct TokenStream
+{
+	std::vector<TokenType> types;
+	std::vector<TokenPayload> payloads;
+	std::vector<uint32_t> offsets;
+	//Source the offsets point into, used to give diagnostics a location. Null if the source is not kept around
+	SourceBuffer* source = nullptr;
+	//Offset of the byte which could not be lexed when tokenizing fails
+	uint32_t error_offset = 0;
+
+	int size() const { return (int)types.size(); }
+};
+
+//A single token as handed out by the streaming lexer
 struct Token
 {
 	TokenType type;
-	const char* name;
-	int row;
-	int column;
-	long parsed_int;
-	TokenFlags flags = 0;
+	TokenPayload payload;
+	uint32_t offset;
+};
+
+//Chunks smaller than this are not worth a thread of their own
+#define TOKENIZE_MIN_CHUNK_SIZE (256 * 1024)
+
+#define LEXER_CHUNK_SIZE (64 * 1024)
+#define LEXER_LOOKAHEAD 16
+
+//Pull based lexer which reads the file in fixed size chunks, so memory use does not depend on the file size
+struct Lexer
+{
+	FILE* file = nullptr;
+	char* buffer = nullptr;
+	size_t capacity = 0;
+	size_t begin = 0;
+	size_t end = 0;
+	//File offset of buffer[0]
+	size_t buffer_offset = 0;
+	bool eof = false;
+	bool failed = false;
+	uint32_t error_offset = 0;
+	Token lookahead[LEXER_LOOKAHEAD];
+	int lookahead_begin = 0;
+	int lookahead_count = 0;
+};
+
+//Implementation used for skipping whitespace and finding the end of identifier and digit runs
+enum class ScanMode
+{
+	SCALAR,
+	SSE2,
+	AVX2,
 };
 
-extern bool tokenize_file(const char* filepath, std::vector<Token*>& tokens);
+extern ScanMode scan_mode_best();
+extern ScanMode tokenize_set_scan_mode(ScanMode mode);
+extern ScanMode tokenize_scan_mode();
+extern TokenFlags token_flags(TokenType type);
+extern void token_error(const TokenStream& tokens, int index, const char* message);
+extern void token_stream_push(TokenStream& tokens, const Token& token);
+extern bool tokenize_buffer(const char* buffer, size_t length, TokenStream& tokens);
+extern bool tokenize_buffer_parallel(const char* buffer, size_t length, TokenStream& tokens, int thread_count);
+extern bool lexer_open(Lexer* lexer, const char* filepath);
+extern void lexer_close(Lexer* lexer);
+extern const Token* lexer_peek(Lexer* lexer, int distance);
+extern bool lexer_next_token(Lexer* lexer, Token* token);